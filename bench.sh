@@ -0,0 +1,104 @@
+#!/bin/sh
+# Benchmarks of the five tools on synthetic graphs (see gen.c), no dataset to download.
+#
+# make bench, or: ./bench.sh [-s]
+# - each tool runs on each graph for each number of threads in THREADS, each a in AS and each dmax in DMAXS,
+#   with the JSON report of the engine (-j)
+# - results in bench/results.tsv: per-phase time (s), wedges/s, imbalance, peak RSS,
+#   and the scaling efficiency of the computation t(1)/(p*t(p)) (if THREADS starts with 1)
+# - if bench/baseline.tsv exists, the computation time of each run is compared to it
+# - -s: save the results as the new baseline
+#
+# The sizes, seeds and parameters can be changed with the environment variables below.
+
+SCALE=${SCALE:-16} # graphs of 2^SCALE nodes
+EDGES=${EDGES:-500000}
+SEED=${SEED:-1}
+THREADS=${THREADS:-"1 2 4"}
+AS=${AS:-"0.3 0.6"}
+DMAXS=${DMAXS:-"10 100"}
+DIR=bench
+
+mkdir -p $DIR/json
+N=$((1<<SCALE))
+OUT=$DIR/results.tsv
+
+# graphs: name (with the size and seed, so that a graph is generated again if they change) and generator arguments
+graphs() {
+	echo "rmat-$SCALE-$EDGES-$SEED rmat $SCALE $EDGES $SEED 0.57 0.19 0.19"
+	echo "chunglu-$SCALE-$EDGES-$SEED chunglu $N $EDGES $SEED 2.5"
+	echo "er-$SCALE-$EDGES-$SEED er $N $EDGES $SEED"
+}
+
+# runs: tool and parameters
+runs() {
+	echo "sim"
+	for d in $DMAXS; do echo "sim_nohub $d"; done
+	for a in $AS; do echo "cosine_opt $a"; done
+	for a in $AS; do echo "jaccard_opt $a"; done
+	for a in $AS; do for d in $DMAXS; do echo "jaccard_opt_nohub $a $d"; done; done
+}
+
+# aligned columns of a tab-separated table
+table() {
+	awk -F'\t' '{ for (i=1;i<=NF;i++) { c[NR,i]=$i; if (length($i)>w[i]) w[i]=length($i) } if (NF>nf) nf=NF }
+		END { for (r=1;r<=NR;r++) { for (i=1;i<=nf;i++) printf "%-*s  ", w[i], c[r,i]; printf "\n" } }'
+}
+
+# value of a field of the report: field file
+field() {
+	sed -n "s/.*\"$1\": \([0-9.e+-]*\).*/\1/p" $2 | head -1
+}
+
+# the loops read here-documents, not pipes: an exit stops the script, not a subshell
+while read name args; do
+	if [ ! -f $DIR/$name.bin ]; then
+		./gen $args > $DIR/$name.txt || { echo "generating $name failed"; rm -f $DIR/$name.txt; exit 1; }
+		./sim 1 $DIR/$name.txt $DIR/$name.bin > /dev/null || { echo "building $name.bin failed"; rm -f $DIR/$name.bin; exit 1; }
+	fi
+done <<EOF
+$(graphs)
+EOF
+
+printf "graph\ttool\tparams\tthreads\tread\torder\tbuild\tschedule\tcompute\ttotal\twedges_per_s\timbalance\tpeak_rss_kb\tefficiency\n" > $OUT
+while read name args; do
+	while read tool prm; do
+		c1=
+		for p in $THREADS; do
+			key=$name.$tool.$(echo $prm | tr ' ' _).$p
+			# the *_opt* tools need the degree ordering: they read the text file
+			case $tool in
+				sim*) in=$DIR/$name.bin;;
+				*) in=$DIR/$name.txt;;
+			esac
+			./$tool -j $DIR/json/$key.json $p $prm $in > $DIR/json/$key.log || { echo "$key failed"; exit 1; }
+			j=$DIR/json/$key.json
+			c=$(field compute $j)
+			[ $p = 1 ] && c1=$c
+			eff=$(echo "${c1:-0} $c $p" | awk '{ if ($1>0 && $2>0) printf "%.3f", $1/($3*$2); else print "-" }')
+			printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" $name $tool "${prm:--}" $p \
+				$(field read $j) $(field order $j) $(field build $j) $(field schedule $j) $c $(field total $j) \
+				$(field wedges_per_s $j) $(field imbalance $j) $(field peak_rss_kb $j) $eff >> $OUT
+		done
+	done <<EOF
+$(runs)
+EOF
+done <<EOF
+$(graphs)
+EOF
+
+table < $OUT
+
+if [ -f $DIR/baseline.tsv ]; then
+	echo
+	echo "Computation time against bench/baseline.tsv (ratio < 1: faster)"
+	awk -F'\t' 'BEGIN { print "graph\ttool\tparams\tthreads\tbaseline\tcompute\tratio" }
+		NR==FNR { if (FNR>1) base[$1 FS $2 FS $3 FS $4]=$9; next }
+		FNR>1 { k=$1 FS $2 FS $3 FS $4; if (k in base && base[k]>0) printf "%s\t%s\t%s\t%s\t%.3f\t%.3f\t%.2f\n", $1, $2, $3, $4, base[k], $9, $9/base[k] }' \
+		$DIR/baseline.tsv $OUT | table
+fi
+
+if [ "$1" = "-s" ]; then
+	cp $OUT $DIR/baseline.tsv
+	echo "Saved as bench/baseline.tsv"
+fi
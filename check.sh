@@ -0,0 +1,52 @@
+#!/bin/sh
+# Out-of-core check (see ooc.h): on graphs whose lists of neighbors are larger than the memory budget,
+# neighsim -M gives the same histogram as in memory, in a number of passes bounded by 4*(size(adj)/budget+1)^2.
+#
+# make check, or: ./check.sh
+#
+# The sizes, seeds and budget (in MB) can be changed with the environment variables below.
+
+SCALE=${SCALE:-17} # graphs of 2^SCALE nodes
+EDGES=${EDGES:-500000}
+SEED=${SEED:-1}
+BUDGET=${BUDGET:-1}
+DIR=check
+
+mkdir -p $DIR
+N=$((1<<SCALE))
+
+graphs() {
+	echo "er-$SCALE-$EDGES-$SEED er $N $EDGES $SEED"
+	echo "rmat-$SCALE-$EDGES-$SEED rmat $SCALE $EDGES $SEED 0.57 0.19 0.19"
+}
+
+# histogram and number of non-zero similarities of an output
+hist() {
+	grep '^\]\|^Number of non-zero' $1
+}
+
+# the loop reads a here-document, not a pipe: an exit stops the script, not a subshell
+while read name args; do
+	if [ ! -f $DIR/$name.bin ]; then
+		./gen $args > $DIR/$name.txt || { echo "generating $name failed"; rm -f $DIR/$name.txt; exit 1; }
+		./sim 1 $DIR/$name.txt $DIR/$name.bin > /dev/null || { echo "building $name.bin failed"; rm -f $DIR/$name.bin; exit 1; }
+	fi
+	./neighsim 2 $DIR/$name.bin > $DIR/$name.mem || { echo "$name: in memory failed"; exit 1; }
+	./neighsim -M $BUDGET 2 $DIR/$name.bin > $DIR/$name.ooc || { echo "$name: out of core failed"; exit 1; }
+	# adj is 2*e neighbors of 4 bytes
+	e=$(sed -n 's/^Number of edges: //p' $DIR/$name.ooc)
+	passes=$(sed -n 's/.* in \([0-9]*\) passes .*/\1/p' $DIR/$name.ooc)
+	max=$(echo "$e $BUDGET" | awk '{ r=int(8*$1/($2*1048576))+1; print 4*(r+1)*(r+1) }')
+	hist $DIR/$name.mem > $DIR/$name.hist
+	if ! hist $DIR/$name.ooc | cmp -s - $DIR/$name.hist; then
+		echo "$name: the histograms differ"
+		exit 1
+	fi
+	if [ $passes -gt $max ]; then
+		echo "$name: $passes passes, more than $max"
+		exit 1
+	fi
+	echo "$name: same histogram, $passes passes (at most $max)"
+done <<EOF
+$(graphs)
+EOF
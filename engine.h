@@ -0,0 +1,774 @@
+/*
+Similarity engine shared by neighsim.c and the five original tools.
+
+A metric is a function f(|Δ(u)∩Δ(w)|,d(u),d(w)) giving NVAL similarities and, for a threshold a,
+a lower bound on d(u)/d(w) (u having the smallest degree) below which all its similarities are lower than a.
+To add a metric: write its eval_/bound_ functions and NVAL_ below, include kernel.h for it and add it to metrics[].
+If f(o,d(u),d(w))>=a iff o is at least some overlap, define JOIN_ and overlap_ for the exact threshold join (join.h).
+*/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <omp.h>
+
+#include "graph.h"
+#include "pairout.h"
+#include "order.h"
+#include "sched.h"
+#include "ooc.h"
+#include "shard.h"
+#include "report.h"
+#include "join.h"
+#include "topk.h"
+#include "stats.h"
+
+
+typedef struct {
+	unsigned metric;//index in metrics[]
+	double a;//similarity threshold: pruning (if the metric allows it) and pairs output
+	unsigned dmax;//only common neighbors with degree smaller or equal to dmax, NODMAX for all
+	char *prefix;//output the pairs in files prefix.<thread>, NULL for none
+	int text;//pairs in text instead of binary
+	unsigned hashmax;//sources with a larger 2-hop estimate use dense accumulators
+	unsigned order;//locality ordering of the nodes without degree ordering (see order.h)
+	char *report;//write a JSON report of the run in this file, NULL for none
+	int cmp;//compress the lists of neighbors (see compress)
+	size_t budget;//memory for the lists of neighbors in bytes, out of core (see ooc.h), 0 for all in memory
+	int append;//append the pairs to the files (passes of an out-of-core run)
+	unsigned nshards;//worker processes, each computing a range of the sources (see shard.h)
+	int join;//exact threshold join: only the pairs with a similarity of at least a (see join.h)
+	unsigned topk;//only the k best partners of each node in the pairs (see kernel.h), 0 for all the pairs
+	char *batch;//edge insertions and deletions applied to the graph, incremental update (see update.h), NULL for a full run
+	char *base;//output of the run before the batch, whose histogram is updated, NULL for none
+	unsigned lsh;//hashes per node of the approximate join (see lsh.h), 0 for none
+	int verify;//approximate join: the candidates are verified instead of estimated
+	double eps;//estimated histogram: relative error of its buckets at 95% confidence (see sample.h), 0 for none
+	double tmax;//estimated histogram: time budget in seconds, 0 for none
+	unsigned dir;//neighborhoods of a directed graph: DIR_NONE (symmetrized), DIR_OUT or DIR_IN (see graph.h)
+	finestats *fine;//finer statistics of the pairs counted by the kernels (see stats.h), NULL for none
+} params;
+
+size_t binsearch(unsigned *tab, size_t l, size_t r, unsigned x){
+	size_t mid = l + (r - l + 1)/2;
+	if (tab[mid] == x)//x always in tab
+		return mid+1;
+	if (tab[mid] > x)
+		return binsearch(tab, l, mid-1, x);
+	return binsearch(tab, mid+1, r, x);
+}
+
+//original label of node u
+static inline unsigned nodeid(graph *g,unsigned u){
+	return (g->map!=NULL)?g->map[u]:u;
+}
+
+//splitmix64 finalizer: a random 64-bit hash of x
+static inline unsigned long long mix64(unsigned long long x){
+	x+=0x9e3779b97f4a7c15ULL;
+	x=(x^(x>>30))*0xbf58476d1ce4e5b9ULL;
+	x=(x^(x>>27))*0x94d049bb133111ebULL;
+	return x^(x>>31);
+}
+
+
+//Per-thread accumulator of the number of common neighbors (or their weights) of a source u and each node w.
+//Either dense arrays of n entries, only allocated the first time a source needs them,
+//or an open-addressing hash table sized to the 2-hop estimate of u: sum of d(v) over its neighbors v.
+#define HASHMAX 65536 //default largest 2-hop estimate using a hash table (and n/256, so that it is much smaller than the dense arrays)
+#define EMPTY UINT_MAX
+#define HASH(w) ((w)*2654435761u)
+
+typedef struct {
+	size_t accsize;//size of a counter (unsigned or float)
+	unsigned *list;//nodes (dense) or slots (hash) having a non-zero counter
+	unsigned lmax;
+	void *inter;//dense: counter of each node, 0 if absent
+	unsigned *key;//hash: node of each slot, EMPTY if free
+	void *val;//hash: counter of each slot
+	unsigned hmax;
+	size_t bytes;//memory currently allocated
+} accum;
+
+void initaccum(accum *acc,size_t accsize){
+	bzero(acc,sizeof(accum));
+	acc->accsize=accsize;
+}
+
+//make room for a source with 2-hop estimate est, returns the mask of the hash table
+unsigned prepareaccum(accum *acc,unsigned n,unsigned long long est,bool hashed){
+	unsigned size=16,l=(est<n)?est:n;
+	if (acc->lmax<l){
+		free(acc->list);
+		l=(2*acc->lmax>l)?2*acc->lmax:l;
+		l=(l<n)?l:n;
+		acc->bytes+=(size_t)(l-acc->lmax)*sizeof(unsigned);
+		acc->lmax=l;
+		acc->list=malloc(l*sizeof(unsigned));
+	}
+	if (!hashed){
+		if (acc->inter==NULL){
+			acc->inter=calloc(n,acc->accsize);
+			acc->bytes+=n*acc->accsize;
+		}
+		return 0;
+	}
+	while (size<2*est)
+		size*=2;
+	if (acc->hmax<size){
+		free(acc->key);
+		free(acc->val);
+		acc->bytes+=(size_t)(size-acc->hmax)*(sizeof(unsigned)+acc->accsize);
+		acc->hmax=size;
+		acc->key=malloc(size*sizeof(unsigned));
+		memset(acc->key,0xff,size*sizeof(unsigned));//EMPTY
+		acc->val=malloc(size*acc->accsize);
+	}
+	return size-1;
+}
+
+void freeaccum(accum *acc){
+	free(acc->list);
+	free(acc->inter);
+	free(acc->key);
+	free(acc->val);
+}
+
+
+//metrics:
+#define NVAL_cosine 1
+#define JOIN_cosine 1
+static inline void eval_cosine(double *val,unsigned i,unsigned du,unsigned dw){
+	val[0]=((double)i)/sqrt(((double)du)*((double)dw));
+}
+double bound_cosine(double a){
+	return a*a;
+}
+//smallest number of common neighbors for a similarity of at least a
+static inline double overlap_cosine(double a,double du,double dw){
+	return a*sqrt(du*dw);
+}
+
+#define NVAL_jaccard 1
+#define JOIN_jaccard 1
+static inline void eval_jaccard(double *val,unsigned i,unsigned du,unsigned dw){
+	val[0]=((double)i)/((double)(du+dw-i));
+}
+double bound_jaccard(double a){
+	return a;
+}
+static inline double overlap_jaccard(double a,double du,double dw){
+	return a*(du+dw)/(1.+a);
+}
+
+#define NVAL_f1 1
+#define JOIN_f1 1
+static inline void eval_f1(double *val,unsigned i,unsigned du,unsigned dw){
+	val[0]=2.*((double)i)/((double)(du+dw));
+}
+double bound_f1(double a){
+	return a/(2.-a);
+}
+static inline double overlap_f1(double a,double du,double dw){
+	return a*(du+dw)/2.;
+}
+
+//cosine, jaccard and F1 at once (sim.c)
+#define NVAL_all 3
+#define MAXVAL NVAL_all //largest number of similarities of a metric
+static inline void eval_all(double *val,unsigned i,unsigned du,unsigned dw){
+	eval_cosine(val,i,du,dw);
+	eval_jaccard(val+1,i,du,dw);
+	eval_f1(val+2,i,du,dw);
+}
+double bound_all(double a){
+	(void)a;
+	return 0.;
+}
+
+//hub promoted and hub depressed indices
+#define NVAL_hpi 1
+static inline void eval_hpi(double *val,unsigned i,unsigned du,unsigned dw){
+	val[0]=((double)i)/((double)((du<dw)?du:dw));
+}
+double bound_hpi(double a){
+	(void)a;
+	return 0.;
+}
+
+#define NVAL_hdi 1
+#define JOIN_hdi 1
+static inline void eval_hdi(double *val,unsigned i,unsigned du,unsigned dw){
+	val[0]=((double)i)/((double)((du>dw)?du:dw));
+}
+double bound_hdi(double a){
+	return a;
+}
+static inline double overlap_hdi(double a,double du,double dw){
+	return a*((du>dw)?du:dw);
+}
+
+//weighted metrics: sum over the common neighbors v of a weight of d(v), precomputed in g->wt
+//the bound is not a degree ratio: nodes u whose neighbor weights sum to less than a are skipped
+#define NVAL_aa 1
+#define WEIGHTED_aa 1
+float weight_aa(unsigned d){
+	return (d>1)?1./log((double)d):0.;
+}
+static inline void eval_aa(double *val,float s,unsigned du,unsigned dw){
+	(void)du;
+	(void)dw;
+	val[0]=s;
+}
+double bound_aa(double a){
+	return a;
+}
+
+#define NVAL_ra 1
+#define WEIGHTED_ra 1
+float weight_ra(unsigned d){
+	return (d>0)?1./d:0.;
+}
+static inline void eval_ra(double *val,float s,unsigned du,unsigned dw){
+	(void)du;
+	(void)dw;
+	val[0]=s;
+}
+double bound_ra(double a){
+	return a;
+}
+
+
+#define CAT_(a,b) a##b
+#define CAT(a,b) CAT_(a,b)
+#define KNAME_(m,p,h) kernel_##m##_##p##h
+#define KNAME(m,p,h) KNAME_(m,p,h)
+#define JNAME_(m,h) join_##m##_##h
+#define JNAME(m,h) JNAME_(m,h)
+#define NVAL(m) CAT(NVAL_,m)
+#define EVAL(m) CAT(eval_,m)
+#define BOUND(m) CAT(bound_,m)
+#define WEIGHTED(m) CAT(WEIGHTED_,m)
+#define JOINABLE(m) CAT(JOIN_,m)
+#define OVERLAP(m) CAT(overlap_,m)
+
+#define METRIC all
+#include "kernel.h"
+#define METRIC cosine
+#include "kernel.h"
+#define METRIC jaccard
+#include "kernel.h"
+#define METRIC f1
+#include "kernel.h"
+#define METRIC hpi
+#include "kernel.h"
+#define METRIC hdi
+#include "kernel.h"
+#define METRIC aa
+#include "kernel.h"
+#define METRIC ra
+#include "kernel.h"
+
+//similarities from a counter of common neighbors (or their weights), for the queries (see server.h)
+#define EVALC(m) \
+static void evalc_##m(double *val,double c,unsigned du,unsigned dw){ \
+	EVAL(m)(val,c,du,dw); \
+}
+EVALC(all)
+EVALC(cosine)
+EVALC(jaccard)
+EVALC(f1)
+EVALC(hpi)
+EVALC(hdi)
+EVALC(aa)
+EVALC(ra)
+
+typedef unsigned long long* (*kernelfn)(graph*,params*,schedule*,threadstats*);
+
+typedef struct {
+	char *name;//for the command line
+	char *desc;//for the messages
+	unsigned nval;
+	int norm;//values in [0,1]
+	double (*bound)(double);
+	void (*eval)(double*,double,unsigned,unsigned);//similarities from a counter c of common neighbors of nodes of degrees du and dw
+	float (*weight)(unsigned);//weight of a common neighbor of degree d, NULL if not weighted
+	kernelfn kernel[2][2];//[PRUNE][NOHUB]
+	kernelfn join[2];//[NOHUB], exact threshold join (see join.h), NULL if the metric has none
+} metricinfo;
+
+#define METRICINFO(m,desc,norm,weight,join) {#m,desc,NVAL(m),norm,BOUND(m),evalc_##m,weight,{{KNAME(m,0,0),KNAME(m,0,1)},{KNAME(m,1,0),KNAME(m,1,1)}},join}
+#define JOINS(m) {JNAME(m,0),JNAME(m,1)}
+#define NOJOIN {NULL,NULL}
+
+metricinfo metrics[]={
+	METRICINFO(all,"cosine, jaccard and F1",1,NULL,NOJOIN),
+	METRICINFO(cosine,"cosine",1,NULL,JOINS(cosine)),
+	METRICINFO(jaccard,"jaccard",1,NULL,JOINS(jaccard)),
+	METRICINFO(f1,"F1",1,NULL,JOINS(f1)),
+	METRICINFO(hpi,"hub promoted",1,NULL,NOJOIN),
+	METRICINFO(hdi,"hub depressed",1,NULL,JOINS(hdi)),
+	METRICINFO(aa,"Adamic-Adar",0,weight_aa,NOJOIN),
+	METRICINFO(ra,"resource allocation",0,weight_ra,NOJOIN),
+};
+#define NMETRICS (sizeof(metrics)/sizeof(metricinfo))
+
+//index of the metric called name, -1 if none
+int findmetric(char *name){
+	unsigned i;
+	for (i=0;i<NMETRICS;i++) {
+		if (strcmp(metrics[i].name,name)==0)
+			return i;
+	}
+	return -1;
+}
+
+params defaultparams(){
+	params prm={0,0.,NODMAX,NULL,0,HASHMAX,ORD_NONE,NULL,0,0,0,1,0,0,NULL,NULL,0,0,0.,0.,DIR_NONE,NULL};
+	return prm;
+}
+
+//degree ordering and pruning are used iff the threshold gives a bound
+int pruned(params *prm){
+	return metrics[prm->metric].bound(prm->a)>0;
+}
+
+//kernel of the run
+kernelfn getkernel(params *prm){
+	if (prm->join)
+		return metrics[prm->metric].join[prm->dmax!=NODMAX];
+	return metrics[prm->metric].kernel[pruned(prm)][prm->dmax!=NODMAX];
+}
+
+//weight of each node for weighted metrics, from its original degree
+void nodeweights(graph *g,float (*weight)(unsigned)){
+	unsigned i;
+	g->wt=malloc(g->n*sizeof(float));
+	#pragma omp parallel for
+	for (i=0;i<g->n;i++) {
+		g->wt[i]=weight(g->d0[i]);
+	}
+}
+
+void printtime(double *t1){
+	double t2=now();
+	long t=t2-*t1;
+	printf("- Time = %ldh%ldm%lds\n",t/3600,(t%3600)/60,t%60);
+	*t1=t2;
+}
+
+//flag of the binary graph of a direction
+unsigned dirflag(unsigned dir){
+	return (dir==DIR_OUT)?BIN_OUT:(dir==DIR_IN)?BIN_IN:0;
+}
+
+//read or load the graph with the layout needed by the kernel, NULL if the binary graph does not fit
+//if binout is not NULL, the built graph is written in it
+//the time of each phase is added to st
+graph* loadgraph(params *prm,char *input,char *binout,double *t1,runstats *st){
+	graph *g;
+	binheader h;
+	int prune=pruned(prm);
+
+	if (isbin(input)){
+		printf("Loading binary graph from file %s\n",input);
+		g=loadbin(input,&h);
+		endphase(st,PH_READ);
+		if ((h.flags&(BIN_OUT|BIN_IN))!=dirflag(prm->dir)){
+			if (prm->dir==DIR_NONE)
+				fprintf(stderr,"%s was built for a directed graph\n",input);
+			else
+				fprintf(stderr,"%s was not built for the %s-neighborhoods\n",input,dirnames[prm->dir]);
+			freegraph(g);
+			return NULL;
+		}
+		if (prune && (!(h.flags&BIN_ASC) || h.dmax!=prm->dmax)){
+			fprintf(stderr,"%s was not built with degree ordering for dmax=%u\n",input,prm->dmax);
+			freegraph(g);
+			return NULL;
+		}
+		if (!prune){
+			if (!(h.flags&BIN_DESC)){
+				fprintf(stderr,"%s was not built without degree ordering\n",input);
+				freegraph(g);
+				return NULL;
+			}
+			if (prm->dmax!=NODMAX){
+				filterdeg(g,prm->dmax);
+			}
+			else {
+				g->d=g->d0;
+			}
+			endphase(st,PH_BUILD);
+		}
+
+		printf("Number of nodes: %u\n",g->n);
+		printf("Number of edges: %zu\n",g->e);
+		return g;
+	}
+
+	if (prm->dir!=DIR_NONE && prm->order!=ORD_NONE){
+		fprintf(stderr,"Directed graph without locality ordering (-r)\n");
+		return NULL;
+	}
+	printf("Reading edgelist from file %s\n",input);
+	g=readedgelist(input);
+	endphase(st,PH_READ);
+
+	printtime(t1);
+
+	printf("Number of nodes: %u\n",g->n);
+	printf("Number of edges: %zu\n",g->e);
+
+	if (prm->dir!=DIR_NONE){
+		printf("Directed graph: similarities of the %s-neighborhoods\n",dirnames[prm->dir]);
+		directed(g,prm->dir);
+	}
+	if (prune){
+		printf("Degree Ordering\n");
+		degord(g,prm->dmax);
+		relabel(g);
+	}
+	else if (prm->order!=ORD_NONE){
+		printf("Ordering nodes (%s)\n",ordnames[prm->order]);
+		g->d0=mkcsr(g,0);
+		locord(g,prm->order);
+		relabel(g);
+	}
+	endphase(st,PH_ORDER);
+
+	printf("Building Graph\n");
+
+	g->d0=mkcsr(g,!prune);
+	if (prm->dmax!=NODMAX){
+		filterdeg(g,prm->dmax);
+	}
+	else {
+		g->d=g->d0;
+	}
+	free(g->edges);
+	g->edges=NULL;
+	if (prm->cmp){
+		compress(g,!prune);
+		printf("Compressed neighbors: %zu bytes, %.2f bits per neighbor\n",g->co[g->n],8.*g->co[g->n]/(2.*g->e));
+	}
+	endphase(st,PH_BUILD);
+
+	if (binout!=NULL){
+		printf("Writing binary graph in file %s\n",binout);
+		savebin(g,binout,(prune?BIN_ASC:(BIN_DESC|((g->map!=NULL)?BIN_MAP:0)))|dirflag(prm->dir),prune?prm->dmax:NODMAX);
+	}
+	return g;
+}
+
+//bucket of a similarity x in the histogram
+static inline unsigned bucket(double x){
+	return (x>0.9)?9:(unsigned)floor(x*10);
+}
+
+void printhist(params *prm,unsigned long long *hist){
+	metricinfo *m=metrics+prm->metric;
+	unsigned i,k;
+	unsigned long long tot=0;
+
+	if (prm->lsh>0){
+		printf("APPROXIMATE: ONLY THE ");
+		for (i=0;m->desc[i];i++)
+			putchar(toupper(m->desc[i]));
+		printf(" SIMILARITIES GREATER THAN OR EQUAL TO %lf FOUND BY LSH ARE COUNTED\n",prm->a);
+	}
+	else if (prm->join){
+		printf("EXACT: ONLY THE ");
+		for (i=0;m->desc[i];i++)
+			putchar(toupper(m->desc[i]));
+		printf(" SIMILARITIES GREATER THAN OR EQUAL TO %lf ARE COUNTED\n",prm->a);
+	}
+	else if (pruned(prm)){
+		printf("ONLY ");
+		for (i=0;m->desc[i];i++)
+			putchar(toupper(m->desc[i]));
+		printf(" SIMILARITIES GREATER THAN %lf ARE CORRECT\n",ceil(prm->a*10)/10);
+	}
+	printf("Number of %s similarities in\n",m->desc);
+	for (i=0;i<10;i++){
+		if (i==9 && !m->norm){
+			printf("]0.9, +inf[ = ");
+		}
+		else {
+			printf("]0.%u, %s%u] = ",i,(i<9)?"0.":"1.",(i+1)%10);
+		}
+		for (k=0;k<m->nval;k++){
+			printf((k+1<m->nval)?"%llu, ":"%llu\n",hist[10*k+i]);
+		}
+		tot+=hist[i];
+	}
+	if (m->nval>1){
+		printf("Number of non-zero similarities = %llu\n",tot);
+	}
+	else {
+		printf("Number of non-zero %s similarities = %llu\n",m->desc,tot);
+	}
+}
+
+//out of core: passes of the kernel, each one with its blocks of adj in memory (see ooc.h)
+unsigned long long* oocrun(graph *g,params *prm,char *input,runstats *st){
+	ooc *o;
+	schedule *s,pass;
+	unsigned p,k;
+	unsigned long long *hist=calloc(10*metrics[prm->metric].nval,sizeof(unsigned long long)),*hist_p;
+
+	o=mkooc(g,input,prm->budget);
+	s=mkpasses(g,o,prm->dmax,omp_get_max_threads());
+	printf("Scheduling %u tasks, %u split sources in %u passes over %u blocks of %zu KB\n",s->ntasks,s->nsplits,o->npasses,o->nblk,o->bsize*sizeof(unsigned)>>10);
+	endphase(st,PH_SCHED);
+	pass=*s;
+	for (p=0;p<o->npasses;p++){
+		loadblocks(o,p);
+		endphase(st,PH_READ);
+		pass.tasks=s->tasks+o->pass[p];
+		pass.ntasks=o->pass[p+1]-o->pass[p];
+		prm->append=(p>0);
+		hist_p=getkernel(prm)(g,prm,&pass,st->th);
+		endphase(st,PH_COMPUTE);
+		for (k=0;k<10*metrics[prm->metric].nval;k++)
+			hist[k]+=hist_p[k];
+		free(hist_p);
+	}
+	freeschedule(s);
+	freeooc(o,g);
+	return hist;
+}
+
+//sharded: worker k computes the sources lo..hi-1 with its own mapping of the graph and sends its result on fd
+//its messages go to /dev/null, its pairs to prefix.k.<thread>
+void shardwork(params *prm,char *input,unsigned lo,unsigned hi,unsigned k,int fd){
+	graph *g;
+	schedule *s;
+	unsigned long long *hist;
+	runstats st;
+	double t1=now();
+
+	initstats(&st,omp_get_max_threads());
+	g=loadgraph(prm,input,NULL,&t1,&st);
+	if (g==NULL)
+		exit(1);
+	if (metrics[prm->metric].weight!=NULL){
+		nodeweights(g,metrics[prm->metric].weight);
+		endphase(&st,PH_BUILD);
+	}
+	if (prm->prefix!=NULL){
+		char *prefix=malloc(strlen(prm->prefix)+16);
+		sprintf(prefix,"%s.%u",prm->prefix,k);
+		prm->prefix=prefix;
+	}
+	s=mkschedule(g,lo,hi,prm->dmax,omp_get_max_threads());
+	endphase(&st,PH_SCHED);
+	hist=getkernel(prm)(g,prm,s,st.th);
+	endphase(&st,PH_COMPUTE);
+	if (!sendresult(fd,hist,metrics[prm->metric].nval,&st)){
+		perror("send shard result");
+		exit(1);
+	}
+	exit(0);
+}
+
+//coordinator of prm->nshards workers (see shard.h), their threads are the threads of st
+unsigned long long* shardrun(params *prm,char *input,runstats *st){
+	graph *g;
+	binheader h;
+	unsigned k,i,*bounds,nth=st->nthreads/prm->nshards,nval=metrics[prm->metric].nval;
+	unsigned long long *hist=calloc(10*nval,sizeof(unsigned long long)),*hist_k=malloc(10*nval*sizeof(unsigned long long));
+	int p[2],status,ok=1,*fd=malloc(prm->nshards*sizeof(int));
+	pid_t *pid=malloc(prm->nshards*sizeof(pid_t));
+	double t[NPHASES];
+
+	printf("Loading binary graph from file %s\n",input);
+	g=loadbin(input,&h);
+	st->n=g->n;
+	st->e=g->e;
+	printf("Number of nodes: %u\n",g->n);
+	printf("Number of edges: %zu\n",g->e);
+	endphase(st,PH_READ);
+	bounds=mkshards(g,prm->dmax,prm->nshards);
+	freegraph(g);
+	endphase(st,PH_SCHED);
+
+	printf("Computing in %u processes of %u threads\n",prm->nshards,nth);
+	fflush(stdout);
+	for (k=0;k<prm->nshards;k++){
+		if (pipe(p)<0 || (pid[k]=fork())<0){
+			perror("start shard worker");
+			exit(1);
+		}
+		if (pid[k]==0){
+			for (i=0;i<k;i++)
+				close(fd[i]);
+			close(p[0]);
+			if (freopen("/dev/null","w",stdout)==NULL)
+				exit(1);
+			shardwork(prm,input,bounds[k],bounds[k+1],k,p[1]);
+		}
+		close(p[1]);
+		fd[k]=p[0];
+	}
+	for (k=0;k<prm->nshards;k++){
+		if (recvresult(fd[k],hist_k,nval,t,st->th+k*nth,nth)){
+			for (i=0;i<10*nval;i++)
+				hist[i]+=hist_k[i];
+			printf("Shard %u: sources [%u, %u[, loaded in %.2fs, computed in %.2fs\n",k,bounds[k],bounds[k+1],t[PH_READ]+t[PH_ORDER]+t[PH_BUILD],t[PH_SCHED]+t[PH_COMPUTE]);
+		}
+		else {
+			ok=0;
+		}
+		close(fd[k]);
+	}
+	for (k=0;k<prm->nshards;k++){
+		if (waitpid(pid[k],&status,0)<0 || !WIFEXITED(status) || WEXITSTATUS(status)!=0)
+			ok=0;
+	}
+	endphase(st,PH_COMPUTE);
+	if (!ok){
+		fprintf(stderr,"A shard worker failed\n");
+		free(hist);
+		hist=NULL;
+	}
+	free(bounds);
+	free(hist_k);
+	free(fd);
+	free(pid);
+	return hist;
+}
+
+//end of a run started at t0: overall time, histogram and report
+int endrun(params *prm,runstats *st,unsigned long long *hist,double t0,double t1){
+	t0=t1-t0;
+	printf("- Overall time = %ldh%ldm%lds\n",(long)t0/3600,((long)t0%3600)/60,(long)t0%60);
+
+	printhist(prm,hist);
+	if (prm->fine!=NULL){
+		printfine(prm->fine,metrics[prm->metric].desc,(metrics[prm->metric].nval>1)?"first":metrics[prm->metric].desc,metrics[prm->metric].norm);
+		freefine(prm->fine);
+		prm->fine=NULL;
+	}
+	if (prm->report!=NULL){
+		printf("Writing report in file %s\n",prm->report);
+		writereport(prm->report,st,hist,metrics[prm->metric].nval);
+	}
+	free(hist);
+	freestats(st);
+
+	return 0;
+}
+
+//whole run: read/build the graph (and stop after writing it in binout if not NULL), compute, print
+int simrun(params *prm,char *input,char *binout){
+	graph *g;
+	schedule *s;
+	unsigned long long *hist;
+	runstats st;
+	double t0,t1;
+	t1=now();
+	t0=t1;
+	initstats(&st,omp_get_max_threads()*prm->nshards);
+	st.input=input;
+	st.metric=metrics[prm->metric].name;
+	st.a=prm->a;
+	st.dmax=prm->dmax;
+
+	if (pruned(prm)){
+		printf("Similarities greater than: %g\n",prm->a);
+	}
+	if (prm->dmax!=NODMAX){
+		printf("Only taking into account common neighbors with degree <= %u\n",prm->dmax);
+	}
+
+	if (prm->join && (!pruned(prm) || metrics[prm->metric].join[0]==NULL || prm->budget>0)){
+		fprintf(stderr,"Exact threshold join for cosine, jaccard, F1 or hdi with a>0, in memory only\n");
+		freestats(&st);
+		return 1;
+	}
+	if (prm->topk>0 && (prm->prefix==NULL || prm->join)){
+		fprintf(stderr,"Top-k mode with pairs (-o), without -x\n");
+		freestats(&st);
+		return 1;
+	}
+	if (prm->budget>0 && (binout!=NULL || !isbin(input))){
+		fprintf(stderr,"Out of core computation from a binary graph only: build it first\n");
+		freestats(&st);
+		return 1;
+	}
+	if (prm->nshards>1){
+		if (binout!=NULL || !isbin(input) || prm->budget>0){
+			fprintf(stderr,"Sharded computation from a binary graph in memory only: build it first\n");
+			freestats(&st);
+			return 1;
+		}
+		hist=shardrun(prm,input,&st);
+		if (hist==NULL){
+			freestats(&st);
+			return 1;
+		}
+		printtime(&t1);
+		return endrun(prm,&st,hist,t0,t1);
+	}
+	g=loadgraph(prm,input,binout,&t1,&st);
+	if (g!=NULL && prm->budget>0 && g->cadj!=NULL){
+		fprintf(stderr,"Out of core computation from a binary graph without compression only\n");
+		freegraph(g);
+		g=NULL;
+	}
+	if (g==NULL){
+		freestats(&st);
+		return 1;
+	}
+	if (binout!=NULL){
+		freegraph(g);
+		freestats(&st);
+		return 0;
+	}
+	st.n=g->n;
+	st.e=g->e;
+
+	printtime(&t1);
+
+	if (metrics[prm->metric].weight!=NULL){
+		nodeweights(g,metrics[prm->metric].weight);
+		endphase(&st,PH_BUILD);
+	}
+
+	printf("Computing %s similarities\n",metrics[prm->metric].desc);
+	if (prm->topk>0){
+		printf("Writing the %u best partners of each node in files %s.<thread>\n",prm->topk,prm->prefix);
+	}
+	else if (prm->prefix!=NULL){
+		printf("Writing pairs in files %s.<thread>\n",prm->prefix);
+	}
+
+	if (prm->budget>0){
+		hist=oocrun(g,prm,input,&st);
+	}
+	else {
+		s=mkschedule(g,0,nsources(g),prm->dmax,omp_get_max_threads());
+		printf("Scheduling %u tasks, %u split sources\n",s->ntasks,s->nsplits);
+		endphase(&st,PH_SCHED);
+		hist=getkernel(prm)(g,prm,s,st.th);
+		endphase(&st,PH_COMPUTE);
+		freeschedule(s);
+	}
+
+	printtime(&t1);
+
+	freegraph(g);
+
+	return endrun(prm,&st,hist,t0,t1);
+}
+
+#endif
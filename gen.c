@@ -0,0 +1,162 @@
+/*
+gcc gen.c -O9 -o gen -lm
+./gen rmat scale m seed [a b c] > net.txt
+./gen chunglu n m seed [gamma] > net.txt
+./gen er n m seed > net.txt
+
+Synthetic graphs for the benchmarks (bench.sh), the same for a given seed on any machine:
+- rmat: 2^scale nodes, m edges drawn by recursive quadrant choice with probabilities a, b, c, 1-a-b-c
+        (default 0.57 0.19 0.19: the larger a, the more skewed the degrees)
+- chunglu: n nodes of expected degree proportional to (i+1)^(-1/(gamma-1)), power-law of exponent gamma
+           (default 2.5: the smaller gamma, the more skewed the degrees), m edges
+- er: Erdos-Renyi, n nodes, m edges drawn uniformly
+Self-loops and duplicate edges are removed, so that there may be slightly fewer than m edges.
+Output: "source target" on each line with source < target.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct {
+	unsigned s;
+	unsigned t;
+} edge;
+
+//splitmix64
+unsigned long long rng;
+
+unsigned long long rnd(){
+	unsigned long long z=(rng+=0x9e3779b97f4a7c15ULL);
+	z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+	z=(z^(z>>27))*0x94d049bb133111ebULL;
+	return z^(z>>31);
+}
+
+//uniform in [0,1[
+double rnd01(){
+	return (rnd()>>11)*(1./9007199254740992.);
+}
+
+void rmat(edge *edges,unsigned long long m,unsigned scale,double a,double b,double c){
+	unsigned long long i;
+	unsigned k,s,t;
+	double r;
+	for (i=0;i<m;i++) {
+		s=0;
+		t=0;
+		for (k=0;k<scale;k++) {
+			r=rnd01();
+			s<<=1;
+			t<<=1;
+			if (r<a)
+				continue;
+			if (r<a+b)
+				t|=1;
+			else if (r<a+b+c)
+				s|=1;
+			else {
+				s|=1;
+				t|=1;
+			}
+		}
+		edges[i].s=s;
+		edges[i].t=t;
+	}
+}
+
+//first index i with cw[i]>x, cw is cumulative
+unsigned pick(double *cw,unsigned n,double x){
+	unsigned l=0,r=n-1,mid;
+	while (l<r) {
+		mid=(l+r)/2;
+		if (cw[mid]>x)
+			r=mid;
+		else
+			l=mid+1;
+	}
+	return l;
+}
+
+void chunglu(edge *edges,unsigned long long m,unsigned n,double gamma){
+	unsigned long long i;
+	unsigned k;
+	double *cw=malloc(n*sizeof(double)),tot=0;
+	for (k=0;k<n;k++) {
+		tot+=pow(k+1,-1./(gamma-1));
+		cw[k]=tot;
+	}
+	for (i=0;i<m;i++) {
+		edges[i].s=pick(cw,n,rnd01()*tot);
+		edges[i].t=pick(cw,n,rnd01()*tot);
+	}
+	free(cw);
+}
+
+void er(edge *edges,unsigned long long m,unsigned n){
+	unsigned long long i;
+	for (i=0;i<m;i++) {
+		edges[i].s=rnd()%n;
+		edges[i].t=rnd()%n;
+	}
+}
+
+int compare_edge(void const *a,void const *b){
+	edge const *pa=a;
+	edge const *pb=b;
+	if (pa->s!=pb->s)
+		return (pa->s<pb->s)?-1:1;
+	if (pa->t!=pb->t)
+		return (pa->t<pb->t)?-1:1;
+	return 0;
+}
+
+void usage(char *prog){
+	fprintf(stderr,"%s rmat scale m seed [a b c]\n",prog);
+	fprintf(stderr,"%s chunglu n m seed [gamma]\n",prog);
+	fprintf(stderr,"%s er n m seed\n",prog);
+	exit(1);
+}
+
+int main(int argc,char** argv){
+	unsigned long long m,i,k=0;
+	unsigned n,x;
+	edge *edges;
+
+	if (argc<5)
+		usage(argv[0]);
+	n=atoi(argv[2]);
+	m=atoll(argv[3]);
+	rng=atoll(argv[4]);
+	edges=malloc(m*sizeof(edge));
+
+	if (strcmp(argv[1],"rmat")==0)
+		rmat(edges,m,n,(argc>5)?atof(argv[5]):0.57,(argc>6)?atof(argv[6]):0.19,(argc>7)?atof(argv[7]):0.19);
+	else if (strcmp(argv[1],"chunglu")==0)
+		chunglu(edges,m,n,(argc>5)?atof(argv[5]):2.5);
+	else if (strcmp(argv[1],"er")==0)
+		er(edges,m,n);
+	else
+		usage(argv[0]);
+
+	for (i=0;i<m;i++) {
+		if (edges[i].s>edges[i].t) {
+			x=edges[i].s;
+			edges[i].s=edges[i].t;
+			edges[i].t=x;
+		}
+	}
+	qsort(edges,m,sizeof(edge),compare_edge);
+	for (i=0;i<m;i++) {
+		if (edges[i].s==edges[i].t || (i>0 && compare_edge(edges+i,edges+i-1)==0))
+			continue;
+		edges[k++]=edges[i];
+	}
+	for (i=0;i<k;i++) {
+		printf("%u %u\n",edges[i].s,edges[i].t);
+	}
+	fprintf(stderr,"%llu edges\n",k);
+	free(edges);
+	return 0;
+}
@@ -0,0 +1,755 @@
+/*
+Graph structure and input/output shared by all the tools.
+
+Text input: "source target" on each line, parsed in parallel (see readedgelist), the edges being undirected
+unless only one direction of the neighborhoods is wanted (see directed).
+Binary input: a graph already built by one of the tools (see savebin/loadbin),
+it is mmap'd read-only so that parsing, relabeling and sorting are done only once.
+*/
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+
+#define NLINKS 500000000 //Maximum number of links, will automatically increase if needed.
+#define NONE UINT_MAX //no node
+#define CD32MAX UINT_MAX //largest 2e with 32-bit offsets in cd, 64-bit offsets in cdl above
+
+typedef struct {
+	unsigned s;
+	unsigned t;
+} edge;
+
+typedef struct {
+	//edge list structure:
+	unsigned n;//number of nodes
+	size_t e;//number of edges
+	edge *edges;//list of edges
+
+	unsigned nside; //directed graph (see directed): the sources are the nodes 0..nside-1, 0 if undirected
+
+	//relabel in degree ordering order (*_opt* tools) or in a locality ordering (see order.h)
+	unsigned *rank;
+	unsigned *map;
+
+	//neighborhoods:
+	unsigned *d0; //original degrees (*_nohub tools only)
+	unsigned *d; //degrees
+	unsigned *cd; //cumulative degrees: (start with 0) length=dim+1, NULL if 2e>CD32MAX
+	size_t *cdl; //cumulative degrees if 2e>CD32MAX, NULL otherwise (use listoff)
+	unsigned *adj; //list of neighbors, NULL if compressed
+	unsigned char *cadj; //compressed lists of neighbors (see compress), NULL if not compressed
+	size_t *co; //offset of each compressed list in cadj, length=dim+1
+	int desc; //lists in decreasing order (compressed lists only)
+	float *wt; //weight of each node (weighted metrics only)
+
+	//binary graph (see loadbin):
+	char *mm; //mmap'd file, NULL if the graph was built in memory
+	size_t mmlen;
+} graph;
+
+//offset of the list of u in adj: one branch on the layout, the same for the whole run
+static inline size_t listoff(graph *g,unsigned u){
+	return (g->cd!=NULL)?g->cd[u]:g->cdl[u];
+}
+
+//number of nodes in the list of u
+static inline unsigned listlen(graph *g,unsigned u){
+	return listoff(g,u+1)-listoff(g,u);
+}
+
+//sources of the kernels: the nodes 0..nsources-1
+static inline unsigned nsources(graph *g){
+	return (g->nside>0)?g->nside:g->n;
+}
+
+
+//compute the maximum of three unsigned
+unsigned max3(unsigned a,unsigned b,unsigned c){
+	a=(a>b) ? a : b;
+	return (a>c) ? a : c;
+}
+
+//parse an unsigned integer, p points to a digit
+static inline unsigned parseuint(char **p,char *end){
+	char *q=*p;
+	unsigned x=0;
+	while (q<end && *q>='0' && *q<='9')
+		x=10*x+(*q++-'0');
+	*p=q;
+	return x;
+}
+
+//parse the lines in [p,end), end is just after a newline or at the end of the file
+//lines not starting with two integers (comments...) are skipped
+edge* parsechunk(char *p,char *end,size_t *e,unsigned *n){
+	size_t e1=NLINKS/1000;
+	unsigned s,t;
+	edge *edges=malloc(e1*sizeof(edge));
+
+	*e=0;
+	*n=0;
+	while (p<end) {
+		while (p<end && (*p==' ' || *p=='\t'))
+			p++;
+		if (p<end && *p>='0' && *p<='9') {
+			s=parseuint(&p,end);
+			while (p<end && (*p==' ' || *p=='\t'))
+				p++;
+			if (p<end && *p>='0' && *p<='9') {
+				t=parseuint(&p,end);
+				if (*e==e1) {
+					e1*=2;
+					edges=realloc(edges,e1*sizeof(edge));
+				}
+				edges[*e].s=s;
+				edges[(*e)++].t=t;
+				*n=max3(*n,s,t);
+			}
+		}
+		p=memchr(p,'\n',end-p);
+		if (p==NULL)
+			break;
+		p++;
+	}
+	return edges;
+}
+
+//reading the edgelist from file, in parallel:
+//the mmap'd file is split at newlines in one chunk per thread, each thread parses its chunk
+graph* readedgelist(char* edgelist){
+	graph *g=calloc(1,sizeof(graph));
+	int fd=open(edgelist,O_RDONLY);
+	struct stat st;
+	char *file;
+	unsigned p=omp_get_max_threads(),k;
+	size_t *e_p=calloc(p+1,sizeof(size_t));
+	unsigned *n_p=calloc(p,sizeof(unsigned));
+	edge **edges_p=malloc(p*sizeof(edge*));
+
+	if (fd<0 || fstat(fd,&st)<0){
+		fprintf(stderr,"Cannot open %s\n",edgelist);
+		exit(1);
+	}
+	file=(st.st_size>0)?mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0):NULL;
+	close(fd);
+	if (file==MAP_FAILED){
+		fprintf(stderr,"Cannot mmap %s\n",edgelist);
+		exit(1);
+	}
+	if (file!=NULL)
+		madvise(file,st.st_size,MADV_SEQUENTIAL);
+
+	#pragma omp parallel num_threads(p)
+	{
+		unsigned k=omp_get_thread_num();
+		char *a=file+(size_t)st.st_size*k/p,*b=file+(size_t)st.st_size*(k+1)/p;
+		//chunk k starts after the first newline before its nominal start
+		if (k>0){
+			a=memchr(a-1,'\n',file+st.st_size-(a-1));
+			a=(a==NULL)?file+st.st_size:a+1;
+		}
+		if (k<p-1){
+			b=memchr(b-1,'\n',file+st.st_size-(b-1));
+			b=(b==NULL)?file+st.st_size:b+1;
+		}
+		edges_p[k]=(a<b)?parsechunk(a,b,e_p+k+1,n_p+k):NULL;
+	}
+
+	for (k=0;k<p;k++){
+		e_p[k+1]+=e_p[k];
+		g->n=(n_p[k]>g->n)?n_p[k]:g->n;
+	}
+	g->e=e_p[p];
+	g->n++;
+	g->edges=malloc(g->e*sizeof(edge));
+	#pragma omp parallel for num_threads(p)
+	for (k=0;k<p;k++){
+		memcpy(g->edges+e_p[k],edges_p[k],(e_p[k+1]-e_p[k])*sizeof(edge));
+		free(edges_p[k]);
+	}
+
+	if (file!=NULL)
+		munmap(file,st.st_size);
+	free(e_p);
+	free(n_p);
+	free(edges_p);
+	return g;
+}
+
+
+//Directed graphs, without symmetrization: similarity of the out-neighborhoods (DIR_OUT: bibliographic coupling,
+//or the sources of a bipartite graph) or of the in-neighborhoods (DIR_IN: co-citation, or its targets).
+//The edge s->t becomes s-(n+t) for DIR_OUT, t-(n+s) for DIR_IN: nodes 0..n-1 (the side computed) get their
+//out-lists (in-lists) and nodes n..2n-1 their in-lists (out-lists) when the lists are built as for an undirected
+//graph. A wedge u-v-w from a node of the side is a path u->v<-w (u<-v->w), so that with only the nodes of the side
+//as sources (nsources), the kernels only traverse these wedges and only compute the pairs of the side.
+#define DIR_NONE 0
+#define DIR_OUT 1
+#define DIR_IN 2
+
+char *dirnames[]={"none","out","in"};
+#define NDIRS (sizeof(dirnames)/sizeof(char*))
+
+//index of the direction called name, -1 if none
+int finddir(char *name){
+	unsigned i;
+	for (i=0;i<NDIRS;i++) {
+		if (strcmp(dirnames[i],name)==0)
+			return i;
+	}
+	return -1;
+}
+
+void directed(graph *g,unsigned dir){
+	size_t k;
+	unsigned x;
+	if (g->n>UINT_MAX/2){
+		fprintf(stderr,"Too many nodes for a directed graph\n");
+		exit(1);
+	}
+	#pragma omp parallel for private(x)
+	for (k=0;k<g->e;k++) {
+		if (dir==DIR_IN){
+			x=g->edges[k].s;
+			g->edges[k].s=g->edges[k].t;
+			g->edges[k].t=x;
+		}
+		g->edges[k].t+=g->n;
+	}
+	g->nside=g->n;
+	g->n*=2;
+}
+
+//exclusive prefix sum in parallel: cd[0]=0, cd[i+1]=cd[i]+d[i], in cd or if it is NULL in cdl
+void prefixsum(unsigned *d,unsigned *cd,size_t *cdl,unsigned n){
+	size_t *s_p=calloc(omp_get_max_threads()+1,sizeof(size_t));
+
+	#pragma omp parallel
+	{
+		unsigned p=omp_get_num_threads(),k=omp_get_thread_num(),i;
+		unsigned lo=(size_t)n*k/p,hi=(size_t)n*(k+1)/p;
+		size_t s=0;
+		for (i=lo;i<hi;i++)
+			s+=d[i];
+		s_p[k+1]=s;
+		#pragma omp barrier
+		#pragma omp single
+		for (i=0;i<p;i++)
+			s_p[i+1]+=s_p[i];
+		s=s_p[k];
+		for (i=lo;i<hi;i++) {
+			if (cd!=NULL)
+				cd[i]=s;
+			else
+				cdl[i]=s;
+			s+=d[i];
+		}
+		if (k==p-1){
+			if (cd!=NULL)
+				cd[n]=s;
+			else
+				cdl[n]=s;
+		}
+	}
+	free(s_p);
+}
+
+//sort a list in increasing order: insertion sort for short lists, LSD radix sort on nbytes bytes otherwise
+//tmp has room for l unsigned
+void sortlist(unsigned *list,unsigned l,unsigned *tmp,unsigned nbytes){
+	unsigned i,j,x,b,c[256],*src=list,*dst=tmp,*swap;
+
+	if (l<=32){
+		for (i=1;i<l;i++) {
+			x=list[i];
+			for (j=i;j>0 && list[j-1]>x;j--)
+				list[j]=list[j-1];
+			list[j]=x;
+		}
+		return;
+	}
+	for (b=0;b<8*nbytes;b+=8) {
+		bzero(c,256*sizeof(unsigned));
+		for (i=0;i<l;i++)
+			c[(src[i]>>b)&255]++;
+		for (i=0,x=0;i<256;i++) {
+			j=c[i];
+			c[i]=x;
+			x+=j;
+		}
+		for (i=0;i<l;i++)
+			dst[c[(src[i]>>b)&255]++]=src[i];
+		swap=src;
+		src=dst;
+		dst=swap;
+	}
+	if (src!=list)
+		memcpy(list,src,l*sizeof(unsigned));
+}
+
+//Building the neighborhoods in parallel from the edge list: cd (or cdl for more than CD32MAX neighbors),
+//adj (each list sorted in increasing order, or decreasing order if desc) and returns the degrees
+unsigned* mkcsr(graph *g,int desc){
+	unsigned i,max=0,nbytes;
+	size_t j,k,*pos=malloc(g->n*sizeof(size_t));
+	unsigned *d=calloc(g->n,sizeof(unsigned));
+
+	g->cd=NULL;
+	g->cdl=NULL;
+	if (2*g->e>CD32MAX)
+		g->cdl=malloc((g->n+1)*sizeof(size_t));
+	else
+		g->cd=malloc((g->n+1)*sizeof(unsigned));
+	g->adj=malloc(2*g->e*sizeof(unsigned));
+
+	#pragma omp parallel for
+	for (k=0;k<g->e;k++) {
+		#pragma omp atomic
+		d[g->edges[k].s]++;
+		#pragma omp atomic
+		d[g->edges[k].t]++;
+	}
+	#pragma omp parallel for reduction(max:max)
+	for (i=0;i<g->n;i++) {
+		max=(d[i]>max)?d[i]:max;
+	}
+	printf("Maximum degree: %u\n",max);
+	prefixsum(d,g->cd,g->cdl,g->n);
+	#pragma omp parallel for
+	for (i=0;i<g->n;i++) {
+		pos[i]=listoff(g,i);
+	}
+
+	#pragma omp parallel for private(j)
+	for (k=0;k<g->e;k++) {
+		#pragma omp atomic capture
+		j=pos[g->edges[k].s]++;
+		g->adj[j]=g->edges[k].t;
+		#pragma omp atomic capture
+		j=pos[g->edges[k].t]++;
+		g->adj[j]=g->edges[k].s;
+	}
+	free(pos);
+
+	for (nbytes=1;nbytes<4 && (g->n-1)>>(8*nbytes);nbytes++);
+	#pragma omp parallel private(i,j)
+	{
+		unsigned *tmp=malloc(max*sizeof(unsigned)),*l,x;
+		#pragma omp for schedule(dynamic, 256)
+		for (i=0;i<g->n;i++) {
+			sortlist(g->adj+listoff(g,i),d[i],tmp,nbytes);
+			if (desc){
+				l=g->adj+listoff(g,i);
+				for (j=0;2*j+1<d[i];j++) {
+					x=l[j];
+					l[j]=l[d[i]-1-j];
+					l[d[i]-1-j]=x;
+				}
+			}
+		}
+		free(tmp);
+	}
+
+	return d;
+}
+
+//Compressed lists of neighbors (Boldi-Vigna style gaps, without references):
+//a list is cut in blocks of CBLOCK neighbors, each block is its first neighbor followed by the gaps
+//between consecutive neighbors, all in varint (7 bits per byte, the high bit is set if more bytes follow).
+//A list of more than one block starts with a skip table: first neighbor and offset (from co[u]) of each
+//block after the first, 4 bytes each, so that a neighbor can be found without decoding the whole list.
+#define CBLOCK 64
+
+static inline unsigned nblocks(graph *g,unsigned u){
+	return (listlen(g,u)+CBLOCK-1)/CBLOCK;
+}
+
+static inline unsigned char* putvarint(unsigned char *p,unsigned x){
+	while (x>=128) {
+		*p++=(x&127)|128;
+		x>>=7;
+	}
+	*p++=x;
+	return p;
+}
+
+//unrolled: most gaps take 1 to 3 bytes
+static inline unsigned char* getvarint(unsigned char *p,unsigned *x){
+	unsigned y=p[0];
+	if (y<128){
+		*x=y;
+		return p+1;
+	}
+	y=(y&127)|(p[1]<<7);
+	if (p[1]<128){
+		*x=y;
+		return p+2;
+	}
+	y=(y&16383)|(p[2]<<14);
+	if (p[2]<128){
+		*x=y;
+		return p+3;
+	}
+	y=(y&2097151)|(p[3]<<21);
+	if (p[3]<128){
+		*x=y;
+		return p+4;
+	}
+	*x=(y&268435455)|(p[4]<<28);
+	return p+5;
+}
+
+//encode the sorted list l of d nodes in out, or only count the bytes if out is NULL, returns the number of bytes
+size_t encodelist(unsigned *l,unsigned d,unsigned char *out){
+	unsigned char buf[5],*p;
+	unsigned i,b,x,nb=(d+CBLOCK-1)/CBLOCK,off;
+	size_t len=(nb>1)?8*(size_t)(nb-1):0;
+	for (i=0;i<d;i++) {
+		b=i/CBLOCK;
+		if (i%CBLOCK==0){
+			x=l[i];
+			if (b>0 && out!=NULL){
+				off=len;
+				memcpy(out+8*(b-1),&x,4);
+				memcpy(out+8*(b-1)+4,&off,4);
+			}
+		}
+		else {
+			x=(l[i]>l[i-1])?l[i]-l[i-1]:l[i-1]-l[i];
+		}
+		p=(out!=NULL)?out+len:buf;
+		len+=putvarint(p,x)-p;
+	}
+	return len;
+}
+
+//first byte of the block b of the list of u, *l is its number of nodes
+static inline unsigned char* blockstart(graph *g,unsigned u,unsigned b,unsigned *l){
+	unsigned char *p=g->cadj+g->co[u];
+	unsigned off,d=listlen(g,u),nb=(d+CBLOCK-1)/CBLOCK;
+	*l=(b+1<nb)?CBLOCK:d-b*CBLOCK;
+	if (b>0){
+		memcpy(&off,p+8*(b-1)+4,4);
+		return p+off;
+	}
+	return p+((nb>1)?8*(nb-1):0);
+}
+
+//decode the block b of the list of u in out, returns its number of nodes
+static inline unsigned decodeblock(graph *g,unsigned u,unsigned b,unsigned *out){
+	unsigned i,x,l;
+	unsigned char *p=blockstart(g,u,b,&l);
+	p=getvarint(p,out);
+	if (g->desc){
+		for (i=1;i<l;i++) {
+			p=getvarint(p,&x);
+			out[i]=out[i-1]-x;
+		}
+	}
+	else {
+		for (i=1;i<l;i++) {
+			p=getvarint(p,&x);
+			out[i]=out[i-1]+x;
+		}
+	}
+	return l;
+}
+
+//last block of the (increasing) list of u whose first node is smaller or equal to v
+static inline unsigned findblock(graph *g,unsigned u,unsigned v){
+	unsigned char *p=g->cadj+g->co[u];
+	unsigned l=0,r=nblocks(g,u)-1,mid,x;
+	while (l<r) {
+		mid=(l+r+1)/2;
+		memcpy(&x,p+8*(mid-1),4);
+		if (x<=v)
+			l=mid;
+		else
+			r=mid-1;
+	}
+	return l;
+}
+
+//neighbors of u: in adj, or decoded in *buf (of *size nodes, increased if needed)
+unsigned* neighbors(graph *g,unsigned u,unsigned **buf,unsigned *size){
+	unsigned b,nb;
+	if (g->cadj==NULL)
+		return g->adj+listoff(g,u);
+	if (*size<listlen(g,u)){
+		*size=listlen(g,u);
+		free(*buf);
+		*buf=malloc(*size*sizeof(unsigned));
+	}
+	nb=nblocks(g,u);
+	for (b=0;b<nb;b++)
+		decodeblock(g,u,b,*buf+b*CBLOCK);
+	return *buf;
+}
+
+//compress the lists of neighbors (sorted by mkcsr) and free adj
+void compress(graph *g,int desc){
+	unsigned i;
+	g->co=malloc((g->n+1)*sizeof(size_t));
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for (i=0;i<g->n;i++) {
+		g->co[i+1]=encodelist(g->adj+listoff(g,i),listlen(g,i),NULL);
+	}
+	g->co[0]=0;
+	for (i=0;i<g->n;i++) {
+		g->co[i+1]+=g->co[i];
+	}
+	g->cadj=malloc(g->co[g->n]+1);
+	#pragma omp parallel for schedule(dynamic, 1024)
+	for (i=0;i<g->n;i++) {
+		encodelist(g->adj+listoff(g,i),listlen(g,i),g->cadj+g->co[i]);
+	}
+	g->desc=desc;
+	free(g->adj);
+	g->adj=NULL;
+}
+
+//degrees counting only the neighbors of degree smaller or equal to dmax, from the original degrees d0
+void filterdeg(graph *g,unsigned dmax){
+	unsigned i,j,*l;
+	g->d=calloc(g->n,sizeof(unsigned));
+	#pragma omp parallel private(j,l)
+	{
+	unsigned *buf=NULL,size=0;
+	#pragma omp for schedule(dynamic, 1024)
+	for (i=0;i<g->n;i++) {
+		l=neighbors(g,i,&buf,&size);
+		for (j=0;j<listlen(g,i);j++) {
+			if (g->d0[l[j]]<=dmax){
+				g->d[i]++;
+			}
+		}
+	}
+	free(buf);
+	}
+}
+
+
+typedef struct {
+	unsigned node;
+	unsigned deg;
+} nodedeg;
+
+int compare_nodedeg(void const *a, void const *b){
+	nodedeg const *pa = a;
+	nodedeg const *pb = b;
+	return (pa->deg < pb->deg) ? -1 : 1;
+}
+
+//rank of the nodes by increasing degree, counting only the neighbors of degree smaller or equal to dmax
+void degord(graph *g, unsigned dmax) {
+	unsigned i;
+	size_t k;
+	unsigned *d=calloc(g->n,sizeof(unsigned));
+	nodedeg *nodedeglist=malloc(g->n*sizeof(nodedeg));
+	for (k=0;k<g->e;k++) {
+		d[g->edges[k].s]++;
+		d[g->edges[k].t]++;
+	}
+	for (i=0;i<g->n;i++) {
+		nodedeglist[i].node=i;
+		nodedeglist[i].deg=0;
+	}
+	for (k=0;k<g->e;k++) {
+		if (d[g->edges[k].t]<=dmax){
+			nodedeglist[g->edges[k].s].deg++;
+		}
+		if (d[g->edges[k].s]<=dmax){
+			nodedeglist[g->edges[k].t].deg++;
+		}
+	}
+	free(d);
+	//each side of a directed graph on its own: its sources keep the labels 0..nside-1
+	qsort(nodedeglist,nsources(g),sizeof(nodedeg),compare_nodedeg);
+	qsort(nodedeglist+nsources(g),g->n-nsources(g),sizeof(nodedeg),compare_nodedeg);
+	g->rank=malloc(g->n*sizeof(unsigned));
+	for (i=0;i<g->n;i++) {
+			g->rank[nodedeglist[i].node]=i;
+	}
+	free(nodedeglist);
+}
+
+//relabel the edge list with rank, map gives the original label of each node
+void relabel(graph *g) {
+	unsigned i;
+	size_t k;
+	g->map=malloc(g->n*sizeof(unsigned));
+	for (i=0;i<g->n;i++) {
+		g->map[g->rank[i]]=i;
+	}
+	for (k=0;k<g->e;k++) {
+		g->edges[k].s=g->rank[g->edges[k].s];
+		g->edges[k].t=g->rank[g->edges[k].t];
+	}
+}
+
+
+//binary graph file:
+//header, cd[n+1] (8 bytes each if BIN_CDL), adj[2e] (or if BIN_CMP: co[n+1] 8-byte aligned, cadj[co[n]] padded to 4 bytes),
+//d0[n], d[n], and if BIN_ASC or BIN_MAP: rank[n], map[n]
+#define BIN_MAGIC 0x3147534e //"NSG1"
+#define BIN_DESC 1 //neighbors in decreasing order, original labels (sim.c, sim_nohub.c)
+#define BIN_ASC 2 //neighbors in increasing order, degree-ordered labels (*_opt*.c)
+#define BIN_MAP 4 //with BIN_DESC: labels of a locality ordering (see order.h)
+#define BIN_CMP 8 //compressed lists of neighbors (see compress)
+#define BIN_CDL 16 //64-bit offsets (cdl, more than CD32MAX neighbors)
+#define BIN_OUT 32 //directed graph, out-neighborhoods of nodes 0..n/2-1 (see directed)
+#define BIN_IN 64 //directed graph, in-neighborhoods of nodes 0..n/2-1
+#define NODMAX UINT_MAX //no degree threshold
+
+typedef struct {
+	unsigned magic;
+	unsigned flags;
+	unsigned n;
+	unsigned elo; //number of edges: elo+2^32*ehi
+	unsigned dmax; //degree threshold used to compute d (and the degree ordering for BIN_ASC)
+	unsigned ehi;
+} binheader;
+
+//true if the file is a binary graph written by savebin
+int isbin(char* path){
+	unsigned magic=0;
+	FILE *file=fopen(path,"rb");
+	if (file==NULL)
+		return 0;
+	if (fread(&magic,sizeof(unsigned),1,file)!=1)
+		magic=0;
+	fclose(file);
+	return magic==BIN_MAGIC;
+}
+
+void savebin(graph *g,char* path,unsigned flags,unsigned dmax){
+	binheader h={BIN_MAGIC,flags|((g->cadj!=NULL)?BIN_CMP:0)|((g->cdl!=NULL)?BIN_CDL:0),g->n,g->e&UINT_MAX,dmax,g->e>>32};
+	char pad[8]={0};
+	unsigned *d0=(g->d0!=NULL)?g->d0:g->d;
+	FILE *file=fopen(path,"wb");
+	if (file==NULL){
+		fprintf(stderr,"Cannot write binary graph %s\n",path);
+		exit(1);
+	}
+	fwrite(&h,sizeof(binheader),1,file);
+	if (g->cdl!=NULL)
+		fwrite(g->cdl,sizeof(size_t),g->n+1,file);
+	else
+		fwrite(g->cd,sizeof(unsigned),g->n+1,file);
+	if (g->cadj!=NULL){
+		if (g->cdl==NULL)
+			fwrite(pad,1,((g->n+1)%2)*4,file);//header and cd: 24+4(n+1) bytes
+		fwrite(g->co,sizeof(size_t),g->n+1,file);
+		fwrite(g->cadj,1,g->co[g->n],file);
+		fwrite(pad,1,(4-g->co[g->n]%4)%4,file);
+	}
+	else {
+		fwrite(g->adj,sizeof(unsigned),2*g->e,file);
+	}
+	fwrite(d0,sizeof(unsigned),g->n,file);
+	fwrite(g->d,sizeof(unsigned),g->n,file);
+	if (flags&(BIN_ASC|BIN_MAP)){
+		fwrite(g->rank,sizeof(unsigned),g->n,file);
+		fwrite(g->map,sizeof(unsigned),g->n,file);
+	}
+	fclose(file);
+}
+
+//mmap a binary graph (read-only, zero-copy): no edge list, arrays point into the file
+graph* loadbin(char* path,binheader *h){
+	graph *g=calloc(1,sizeof(graph));
+	struct stat st;
+	unsigned *p;
+	int fd=open(path,O_RDONLY);
+
+	if (fd<0 || fstat(fd,&st)<0){
+		fprintf(stderr,"Cannot open binary graph %s\n",path);
+		exit(1);
+	}
+	g->mmlen=st.st_size;
+	g->mm=mmap(NULL,g->mmlen,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if (g->mm==MAP_FAILED){
+		fprintf(stderr,"Cannot mmap binary graph %s\n",path);
+		exit(1);
+	}
+	memcpy(h,g->mm,sizeof(binheader));
+	g->n=h->n;
+	g->e=h->elo+((size_t)h->ehi<<32);
+	p=(unsigned*)(g->mm+sizeof(binheader));
+	if (h->flags&BIN_CDL){
+		g->cdl=(size_t*)p;
+		p+=2*((size_t)g->n+1);
+	}
+	else {
+		g->cd=p;
+		p+=g->n+1;
+		if (h->flags&BIN_CMP)
+			p+=(g->n+1)%2;
+	}
+	if (h->flags&BIN_CMP){
+		g->co=(size_t*)p;
+		g->cadj=(unsigned char*)(g->co+g->n+1);
+		p=(unsigned*)(g->cadj+(g->co[g->n]+3)/4*4);
+		g->desc=(h->flags&BIN_DESC)!=0;
+	}
+	else {
+		g->adj=p;
+		p+=2*g->e;
+	}
+	g->d0=p;
+	p+=g->n;
+	g->d=p;
+	p+=g->n;
+	if (h->flags&(BIN_OUT|BIN_IN))
+		g->nside=g->n/2;
+	if (h->flags&(BIN_ASC|BIN_MAP)){
+		g->rank=p;
+		p+=g->n;
+		g->map=p;
+		p+=g->n;
+	}
+	if ((char*)p<g->mm || (size_t)((char*)p-g->mm)!=g->mmlen){
+		fprintf(stderr,"Corrupted binary graph %s\n",path);
+		exit(1);
+	}
+	return g;
+}
+
+//free an array unless it lives in the mmap'd binary graph
+void freearray(graph *g,void *p){
+	if (g->mm==NULL || (uintptr_t)p<(uintptr_t)g->mm || (uintptr_t)p>=(uintptr_t)g->mm+g->mmlen)
+		free(p);
+}
+
+void freegraph(graph *g){
+	free(g->edges);
+	freearray(g,g->rank);
+	freearray(g,g->map);
+	if (g->d0!=g->d)
+		freearray(g,g->d0);
+	freearray(g,g->d);
+	freearray(g,g->cd);
+	freearray(g,g->cdl);
+	freearray(g,g->adj);
+	freearray(g,g->cadj);
+	freearray(g,g->co);
+	free(g->wt);
+	if (g->mm!=NULL)
+		munmap(g->mm,g->mmlen);
+	free(g);
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+Number of common nodes of two increasing lists of distinct nodes, used when the candidate pairs are known
+(verification of the exact threshold join, see join.h).
+
+- lists of close sizes: blocks of 4 (SSE2) or 8 (AVX2, if compiled with -mavx2 or -march=native) nodes of
+  each list compared all against all with rotations of one block, the block with the smallest last node
+  is replaced by the next one
+- skewed sizes (one list GALLOP times longer): each node of the short list is searched in the long one
+  by galloping (exponential then binary search) from the last position
+Both stop with less than o as soon as the nodes left cannot reach o common nodes.
+*/
+
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include <stdlib.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+#define GALLOP 32 //size ratio from which the short list is searched in the long one
+
+//c common nodes so far, the nodes a[i..la[ and b[j..lb[ left, by merging
+static inline unsigned mergetail(unsigned *a,unsigned la,unsigned *b,unsigned lb,unsigned i,unsigned j,unsigned c,unsigned o){
+	while (i<la && j<lb) {
+		if (c+((la-i<lb-j)?la-i:lb-j)<o)
+			return c;
+		if (a[i]<b[j])
+			i++;
+		else if (a[i]>b[j])
+			j++;
+		else {
+			c++;
+			i++;
+			j++;
+		}
+	}
+	return c;
+}
+
+//a is the short list
+static inline unsigned gallopcount(unsigned *a,unsigned la,unsigned *b,unsigned lb,unsigned o){
+	unsigned i,j=0,lo,hi,mid,step,c=0;
+	for (i=0;i<la && j<lb;i++){
+		if (c+la-i<o)
+			return c;
+		//b[lo..hi] contains the first node larger or equal to a[i]
+		for (step=1,lo=j,hi=j;hi<lb && b[hi]<a[i];step*=2){
+			lo=hi+1;
+			hi=j+step;
+		}
+		hi=(hi<lb)?hi:lb;
+		while (lo<hi) {
+			mid=lo+(hi-lo)/2;
+			if (b[mid]<a[i])
+				lo=mid+1;
+			else
+				hi=mid;
+		}
+		j=lo;
+		if (j<lb && b[j]==a[i]){
+			c++;
+			j++;
+		}
+	}
+	return c;
+}
+
+//common nodes of a and b, or less than o if they are less than o
+static inline unsigned intersectcount(unsigned *a,unsigned la,unsigned *b,unsigned lb,unsigned o){
+	unsigned i=0,j=0,c=0,x,y;
+	if ((unsigned long long)la*GALLOP<lb)
+		return gallopcount(a,la,b,lb,o);
+	if ((unsigned long long)lb*GALLOP<la)
+		return gallopcount(b,lb,a,la,o);
+#if defined(__AVX2__)
+	__m256i va,vb,m;
+	const __m256i rot=_mm256_setr_epi32(1,2,3,4,5,6,7,0);
+	while (i+8<=la && j+8<=lb) {
+		if (c+((la-i<lb-j)?la-i:lb-j)<o)
+			return c;
+		va=_mm256_loadu_si256((__m256i*)(a+i));
+		vb=_mm256_loadu_si256((__m256i*)(b+j));
+		m=_mm256_cmpeq_epi32(va,vb);
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		vb=_mm256_permutevar8x32_epi32(vb,rot);
+		m=_mm256_or_si256(m,_mm256_cmpeq_epi32(va,vb));
+		c+=__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+		x=a[i+7];
+		y=b[j+7];
+		i+=(x<=y)?8:0;
+		j+=(y<=x)?8:0;
+	}
+#elif defined(__SSE2__)
+	__m128i va,vb,m;
+	while (i+4<=la && j+4<=lb) {
+		if (c+((la-i<lb-j)?la-i:lb-j)<o)
+			return c;
+		va=_mm_loadu_si128((__m128i*)(a+i));
+		vb=_mm_loadu_si128((__m128i*)(b+j));
+		m=_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi32(va,vb),_mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(0,3,2,1)))),
+			_mm_or_si128(_mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(1,0,3,2))),_mm_cmpeq_epi32(va,_mm_shuffle_epi32(vb,_MM_SHUFFLE(2,1,0,3)))));
+		c+=__builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+		x=a[i+3];
+		y=b[j+3];
+		i+=(x<=y)?4:0;
+		j+=(y<=x)?4:0;
+	}
+#endif
+	return mergetail(a,la,b,lb,i,j,c,o);
+}
+
+#endif
@@ -0,0 +1,434 @@
+/*
+Exact threshold join (-x): the pairs with a similarity of at least a, and only them, with the prefix
+and positional filters of AllPairs/PPJoin over the degree-ordered lists (see kernel.h, PRUNE).
+
+For cosine, jaccard, F1 and hdi, sim(u,w)>=a iff the number o of common neighbors is at least
+overlap(a,d(u),d(w)) (OVERLAP_<metric> in engine.h). The lists are in increasing label, i.e. increasing
+degree: the rare neighbors first. If sim(u,w)>=a, the prefixes of u and w (their first d-omin+1 neighbors,
+omin being the smallest overlap over their possible partners) have a common neighbor:
+- index prefix of u, partners w of larger degree: omin=overlap(a,d(u),d(u))
+- probe prefix of w, partners u of smaller degree, at least bound(a)*d(w): omin=overlap(a,bound(a)*d(w),d(w))
+The index gives, for each node v, the nodes u having v in their index prefix and the position of v in their list.
+Each source w scans the index of the neighbors in its probe prefix, from the nodes u<w of largest degree down
+to the degree ratio bound, and counts the hits of each u. u is dropped as soon as its hits plus the neighbors
+left after v in both lists cannot reach the overlap (positional filter). The other candidates are verified by
+intersecting the two lists (intersect.h), stopped as soon as the overlap cannot be reached.
+A source w whose candidates would cost more to verify (up to 2*d(w) nodes each) than ACCUMW times its 2-hop
+traversal rather accumulates the exact overlaps of the nodes u<w in the lists of its neighbors, as the kernel.
+So does a source split by the schedule (see sched.h): each part accumulates over its range of neighbors, the last
+part merges their counters and evaluates the pairs.
+With NOHUB, the neighbors of degree larger than dmax are not in the lists: the positions skip them.
+
+engine.h includes it with METRIC and NOHUB defined (from kernel.h), for the metrics with JOIN_<metric>,
+and it defines join_METRIC_NOHUB(graph*,params*,schedule*,threadstats*).
+*/
+
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "graph.h"
+#include "intersect.h"
+
+
+#define PRUNED UINT_MAX //counter of a candidate dropped by the positional filter
+#define OVEREPS 1e-6 //the overlaps are rounded up after subtracting it, no pair at exactly a is lost
+#define ACCUMW 4 //an accumulated wedge costs about as much as ACCUMW nodes of a verification
+
+typedef struct {
+	size_t *io;//index of node v: ix[io[v]..io[v+1][
+	unsigned long long *ix;//node u (high 32 bits) and position of v in the list of u (low 32 bits), by increasing u
+} prefixindex;
+
+//smallest number of common neighbors from a real overlap
+static inline unsigned minoverlap(double o){
+	return (o>OVEREPS)?(unsigned)ceil(o-OVEREPS):0;
+}
+
+//length of the prefix of a list of d nodes for a smallest overlap o, 0 if no partner can reach it
+static inline unsigned prefixlen(unsigned d,double o){
+	unsigned m=minoverlap(o);
+	if (m>d)
+		return 0;
+	return (m>0)?d-m+1:d;
+}
+
+int compare_ull(void const *a,void const *b){
+	unsigned long long x=*(unsigned long long const*)a,y=*(unsigned long long const*)b;
+	return (x<y)?-1:(x>y);
+}
+
+//index of the first plen[u] neighbors (of degree smaller or equal to dmax) of each node u
+prefixindex* mkindex(graph *g,unsigned *plen,unsigned dmax){
+	prefixindex *x=malloc(sizeof(prefixindex));
+	unsigned u,v,i,j,*l,*cnt=calloc(g->n,sizeof(unsigned));
+	size_t k,*pos=malloc(g->n*sizeof(size_t));
+
+	#pragma omp parallel private(i,j,v,l)
+	{
+	unsigned *buf=NULL,size=0;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<g->n;u++){
+		l=neighbors(g,u,&buf,&size);
+		for (i=0,j=0;j<plen[u];i++){
+			v=l[i];
+			if (g->d0[v]>dmax)
+				continue;
+			#pragma omp atomic
+			cnt[v]++;
+			j++;
+		}
+	}
+	free(buf);
+	}
+	x->io=malloc((g->n+1)*sizeof(size_t));
+	prefixsum(cnt,NULL,x->io,g->n);
+	free(cnt);
+	memcpy(pos,x->io,g->n*sizeof(size_t));
+	x->ix=malloc((x->io[g->n]+1)*sizeof(unsigned long long));
+
+	#pragma omp parallel private(i,j,k,v,l)
+	{
+	unsigned *buf=NULL,size=0;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<g->n;u++){
+		l=neighbors(g,u,&buf,&size);
+		for (i=0,j=0;j<plen[u];i++){
+			v=l[i];
+			if (g->d0[v]>dmax)
+				continue;
+			#pragma omp atomic capture
+			k=pos[v]++;
+			x->ix[k]=((unsigned long long)u<<32)|j;
+			j++;
+		}
+	}
+	free(buf);
+	#pragma omp for schedule(dynamic, 1024)
+	for (v=0;v<g->n;v++){
+		qsort(x->ix+x->io[v],x->io[v+1]-x->io[v],sizeof(unsigned long long),compare_ull);
+	}
+	}
+	free(pos);
+	return x;
+}
+
+void freeindex(prefixindex *x){
+	free(x->io);
+	free(x->ix);
+	free(x);
+}
+
+//first entry of ix[l..r[ larger or equal to y
+static inline size_t lowerbound(unsigned long long *ix,size_t l,size_t r,unsigned long long y){
+	size_t mid;
+	while (l<r) {
+		mid=l+(r-l)/2;
+		if (ix[mid]<y)
+			l=mid+1;
+		else
+			r=mid;
+	}
+	return l;
+}
+
+//common neighbors (of degree smaller or equal to dmax) of the increasing lists a and b,
+//stopped with less than o as soon as o cannot be reached
+static inline unsigned mergecount(graph *g,unsigned *a,unsigned la,unsigned *b,unsigned lb,unsigned o,unsigned dmax){
+	unsigned i=0,j=0,c=0;
+	while (i<la && j<lb) {
+		if (c+((la-i<lb-j)?la-i:lb-j)<o)
+			return c;
+		if (a[i]<b[j])
+			i++;
+		else if (a[i]>b[j])
+			j++;
+		else {
+			if (g->d0[a[i]]<=dmax)
+				c++;
+			i++;
+			j++;
+		}
+	}
+	return c;
+}
+
+#endif
+
+
+#ifdef METRIC
+
+//counter of node u, created at 0 (k, list and n as in the kernel)
+#define SLOT(u) \
+	if (hashed){ \
+		for (k=HASH(u)&mask;hkey[k]!=(u);k=(k+1)&mask){ \
+			if (hkey[k]==EMPTY){ \
+				hkey[k]=(u); \
+				hval[k]=0; \
+				list[n++]=k; \
+				break; \
+			} \
+		} \
+		c=hval+k; \
+	} \
+	else { \
+		if (inter[u]==0){ \
+			list[n++]=(u); \
+		} \
+		c=inter+(u); \
+	}
+
+//node u and counter h of the i-th entry of list, which is cleared
+#define TAKE(i) \
+	if (hashed){ \
+		k=list[i]; \
+		u=hkey[k]; \
+		h=hval[k]; \
+		hkey[k]=EMPTY; \
+	} \
+	else { \
+		u=list[i]; \
+		h=inter[u]; \
+		inter[u]=0; \
+	}
+
+unsigned long long* JNAME(METRIC,NOHUB)(graph *g,params *prm,schedule *s,threadstats *th){
+	unsigned i,k,t,p,q,u,v,w,n,h,o,du,dw,mask,i0,i1,left,*list,*hkey,*hval,*inter,*c,*nu,*nw,*plen=malloc(g->n*sizeof(unsigned));
+	size_t j,j0;
+	unsigned long long est,acost,wedges,cands,pairs;
+	double t0,val[NVAL(METRIC)],r=BOUND(METRIC)(prm->a);
+	unsigned hashmax=(prm->hashmax<g->n/256)?prm->hashmax:g->n/256;
+	unsigned long long *hist_p,*hist=calloc(10*NVAL(METRIC),sizeof(unsigned long long));
+	unsigned nth=omp_get_max_threads();
+	unsigned long long **hists=calloc(nth,sizeof(unsigned long long*)),**fcs=calloc(nth,sizeof(unsigned long long*));
+	bool hashed,accumulated;
+	accum acc;
+	task *tk;
+	splitsource *sp;
+	pairfile *pf;
+	prefixindex *ix;
+
+	//only the prefixes of the sources are indexed: the candidates of a directed graph are on their side
+	#pragma omp parallel for
+	for (u=0;u<g->n;u++)
+		plen[u]=(u<nsources(g))?prefixlen(g->d[u],OVERLAP(METRIC)(prm->a,g->d[u],g->d[u])):0;
+	ix=mkindex(g,plen,prm->dmax);
+	#pragma omp parallel for
+	for (w=0;w<g->n;w++)
+		plen[w]=prefixlen(g->d[w],OVERLAP(METRIC)(prm->a,r*g->d[w],g->d[w]));
+
+	#pragma omp parallel private(i,j,j0,k,t,p,q,u,v,w,n,h,o,du,dw,mask,i0,i1,left,list,hkey,hval,inter,c,nu,nw,est,acost,wedges,cands,pairs,t0,val,hist_p,hashed,accumulated,acc,tk,sp,pf)
+	{
+	unsigned *ubuf=NULL,usize=0,*wbuf=NULL,wsize=0;//decoded neighbors if compressed
+	unsigned long long *fc=(prm->fine!=NULL)?calloc(prm->fine->len,sizeof(unsigned long long)):NULL;//finer statistics of the thread
+	hist_p=calloc(10*NVAL(METRIC),sizeof(unsigned long long));
+	pf=(prm->prefix!=NULL)?openpairs(prm->prefix,omp_get_thread_num(),prm->text,NVAL(METRIC),prm->append):NULL;
+	initaccum(&acc,sizeof(unsigned));
+	wedges=0;
+	cands=0;
+	pairs=0;
+	t0=now();
+
+	#pragma omp for schedule(dynamic, 1) nowait
+	for (t=0;t<s->ntasks;t++){//see mkschedule
+		tk=s->tasks+t;
+		sp=(tk->split!=NONE)?s->splits+tk->split:NULL;
+		for (w=tk->u;w<tk->last;w++){
+			if (plen[w]==0)
+				continue;//all the parts of a split source skip it
+			dw=g->d[w];
+			nw=neighbors(g,w,&wbuf,&wsize);
+			//neighbors nw[i0..i1[ of w accumulated by this part
+			i0=(sp!=NULL)?tk->i0-listoff(g,w):0;
+			i1=(sp!=NULL)?tk->i1-listoff(g,w):listlen(g,w);
+			//upper bound on the number of candidates: index entries of the probe prefix
+			//and cost of accumulating the exact overlaps of w instead: its 2-hop traversal
+			est=0;
+			acost=0;
+			for (i=0,p=0;i<listlen(g,w);i++){
+				v=nw[i];
+#if NOHUB
+				if (g->d0[v]>prm->dmax)
+					continue;
+#endif
+				if (p<plen[w]){
+					est+=ix->io[v+1]-ix->io[v];
+					p++;
+				}
+				if (i>=i0 && i<i1)
+					acost+=listlen(g,v);
+			}
+			if (est==0)
+				continue;//no candidate: all the parts skip it
+			//a verification merges at most 2*d(w) nodes
+			accumulated=(sp!=NULL || (g->cadj==NULL && ACCUMW*acost<est*dw));
+			if (accumulated)
+				est=acost;
+			hashed=(est<=hashmax);
+			mask=prepareaccum(&acc,g->n,est,hashed);
+			list=acc.list;
+			inter=acc.inter;
+			hkey=acc.key;
+			hval=acc.val;
+			n=0;
+			if (accumulated){
+				for (i=i0;i<i1;i++){
+					v=nw[i];
+#if NOHUB
+					if (g->d0[v]>prm->dmax)
+						continue;
+#endif
+					//nodes u<w in the list of v, by decreasing degree
+					nu=neighbors(g,v,&ubuf,&usize);
+					for (j=binsearch(nu,0,listlen(g,v)-1,w)-1;j>0;j--){
+						u=nu[j-1];
+						if (((double)g->d[u])/((double)dw)<r)
+							break;
+						wedges++;
+						SLOT(u)
+						(*c)++;
+					}
+				}
+			}
+			else {
+				for (i=0,p=0;p<plen[w];i++){
+					v=nw[i];
+#if NOHUB
+					if (g->d0[v]>prm->dmax)
+						continue;
+#endif
+					//nodes u<w having v at position q of their index prefix, by decreasing degree
+					j0=ix->io[v];
+					for (j=lowerbound(ix->ix,j0,ix->io[v+1],(unsigned long long)w<<32);j>j0;j--){
+						u=ix->ix[j-1]>>32;
+						q=ix->ix[j-1]&UINT_MAX;
+						du=g->d[u];
+						if (((double)du)/((double)dw)<r){
+							break;
+						}
+						wedges++;
+						SLOT(u)
+						if (*c==PRUNED)
+							continue;
+						o=minoverlap(OVERLAP(METRIC)(prm->a,du,dw));
+						//hits so far, v and the neighbors after v in both lists
+						if (*c+((dw-p<du-q)?dw-p:du-q)<o)
+							*c=PRUNED;
+						else
+							(*c)++;
+					}
+					p++;
+				}
+			}
+			if (sp!=NULL){
+				//export the overlaps of this part, the last part merges them all
+				sp->len[tk->part]=n;
+				sp->w[tk->part]=malloc(n*sizeof(unsigned));
+				sp->c[tk->part]=malloc(n*sizeof(unsigned));
+				for (i=0;i<n;i++){
+					TAKE(i)
+					sp->w[tk->part][i]=u;
+					((unsigned*)sp->c[tk->part])[i]=h;
+				}
+				#pragma omp atomic capture seq_cst
+				left=--sp->left;
+				if (left>0)
+					continue;
+				est=0;
+				for (p=0;p<sp->nparts;p++)
+					est+=sp->len[p];
+				hashed=(est<=hashmax);
+				mask=prepareaccum(&acc,g->n,est,hashed);
+				list=acc.list;
+				inter=acc.inter;
+				hkey=acc.key;
+				hval=acc.val;
+				n=0;
+				for (p=0;p<sp->nparts;p++){
+					for (i=0;i<sp->len[p];i++){
+						u=sp->w[p][i];
+						SLOT(u)
+						*c+=((unsigned*)sp->c[p])[i];
+					}
+					free(sp->w[p]);
+					free(sp->c[p]);
+				}
+			}
+			for (i=0;i<n;i++){
+				TAKE(i)
+				if (h==PRUNED)
+					continue;
+				cands++;
+				du=g->d[u];
+				o=minoverlap(OVERLAP(METRIC)(prm->a,du,dw));
+				if (!accumulated){
+					nu=neighbors(g,u,&ubuf,&usize);
+#if NOHUB
+					h=mergecount(g,nu,listlen(g,u),nw,listlen(g,w),o,prm->dmax);
+#else
+					h=intersectcount(nu,listlen(g,u),nw,listlen(g,w),o);
+#endif
+				}
+				if (h<o)
+					continue;
+				EVAL(METRIC)(val,h,du,dw);
+				if (val[0]<prm->a)
+					continue;
+				for (k=0;k<NVAL(METRIC);k++){
+					if (val[k]>0.9){
+						hist_p[10*k+9]++;
+					}
+					else {
+						hist_p[10*k+(int)(floor(val[k]*10))]++;
+					}
+				}
+				if (fc!=NULL){
+					addfine(prm->fine,fc,val,g->d[u],g->d[w]);
+				}
+				if (pf!=NULL){
+					writepair(pf,nodeid(g,u),nodeid(g,w),val);
+					pairs++;
+				}
+			}
+		}
+	}
+	th[omp_get_thread_num()].busy+=now()-t0;
+	th[omp_get_thread_num()].wedges+=wedges;
+	th[omp_get_thread_num()].cands+=cands;
+	th[omp_get_thread_num()].pairs+=pairs;
+	if (acc.bytes>th[omp_get_thread_num()].scratch)
+		th[omp_get_thread_num()].scratch=acc.bytes;
+	freeaccum(&acc);
+	free(ubuf);
+	free(wbuf);
+	if (pf!=NULL){
+		closepairs(pf);
+	}
+	hists[omp_get_thread_num()]=hist_p;
+	fcs[omp_get_thread_num()]=fc;
+	}
+	//the copies of the threads are added once they are all done, without critical section
+	for (p=0;p<nth;p++){
+		if (hists[p]==NULL)
+			continue;
+		for (i=0;i<10*NVAL(METRIC);i++){
+			hist[i]+=hists[p][i];
+		}
+		free(hists[p]);
+	}
+	if (prm->fine!=NULL){
+		mergefine(prm->fine,fcs,nth);
+	}
+	free(hists);
+	free(fcs);
+	freeindex(ix);
+	free(plen);
+	return hist;
+}
+
+#undef SLOT
+#undef TAKE
+
+#endif
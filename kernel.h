@@ -0,0 +1,408 @@
+/*
+Similarity kernel, specialized at compile time (see engine.h).
+
+engine.h includes this file once per metric with METRIC defined (cosine, jaccard...),
+this first inclusion includes it again for the 4 combinations of:
+- PRUNE: 0: original labels, neighbors in decreasing order, each pair (u,w) with w>u (sim.c)
+         1: degree-ordered labels, neighbors in increasing order, each pair (u,w) with w>u and
+            d(u)/d(w) greater than the bound of the metric (*_opt*.c), or for weighted metrics
+            each u whose neighbor weights sum to at least a
+- NOHUB: 1: only common neighbors with degree smaller or equal to dmax (*_nohub.c)
+and defines kernel_METRIC_PRUNENOHUB(graph*,params*), e.g. kernel_jaccard_11,
+and for the metrics with JOIN_<metric> includes join.h with NOHUB 0 and 1.
+The parameters are preprocessor constants, so each inner loop is branch-free.
+
+Top-k mode (prm->topk>0): the k best partners of each source u are written instead of the pairs. The pair
+(u,w) with w>u being seen from u only, u also traverses the nodes w<u (with degree ordering, down to the
+degree ratio bound), which the histogram does not count. The best partners are kept in a heap of k nodes
+(topk.h), whose root is the similarity a candidate must beat. With degree ordering, u first traverses the nodes
+w>u (the pairs of the histogram), then the nodes w<u in a second pass, down to the degree ratio bound of the
+k-th best similarity so far rather than of a: a node w<u of smaller degree ratio cannot enter the heap.
+*/
+
+#ifndef PRUNE
+
+#define PRUNE 0
+#define NOHUB 0
+#include "kernel.h"
+#undef NOHUB
+#define NOHUB 1
+#include "kernel.h"
+#undef PRUNE
+#undef NOHUB
+#define PRUNE 1
+#define NOHUB 0
+#include "kernel.h"
+#undef NOHUB
+#define NOHUB 1
+#include "kernel.h"
+#undef PRUNE
+#undef NOHUB
+#if JOINABLE(METRIC)
+#define NOHUB 0
+#include "join.h"
+#undef NOHUB
+#define NOHUB 1
+#include "join.h"
+#undef NOHUB
+#endif
+#undef METRIC
+
+#else
+
+//weighted metrics (WEIGHTED_<metric> defined to 1 in engine.h) sum the weights g->wt of the common neighbors
+#if WEIGHTED(METRIC)
+#define ACC float
+#else
+#define ACC unsigned
+#endif
+
+//add x to the counter of node w (k, list and n as in the kernel)
+#define ADD(w,x) \
+	if (hashed){ \
+		for (k=HASH(w)&mask;hkey[k]!=(w);k=(k+1)&mask){ \
+			if (hkey[k]==EMPTY){ \
+				hkey[k]=(w); \
+				hval[k]=0; \
+				list[n++]=k; \
+				break; \
+			} \
+		} \
+		hval[k]+=(x); \
+	} \
+	else { \
+		if (inter[w]==0){ \
+			list[n++]=(w); \
+		} \
+		inter[w]+=(x); \
+	}
+
+//node w and counter c of the i-th entry of list, which is cleared
+#define TAKE(i) \
+	if (hashed){ \
+		k=list[i]; \
+		w=hkey[k]; \
+		c=hval[k]; \
+		hkey[k]=EMPTY; \
+	} \
+	else { \
+		w=list[i]; \
+		c=inter[w]; \
+		inter[w]=0; \
+	}
+
+//histogram of similarity values: NVAL(METRIC) similarities per pair, 10 buckets each
+unsigned long long* KNAME(METRIC,PRUNE,NOHUB)(graph *g,params *prm,schedule *s,threadstats *th){
+	unsigned i,k,t,p,u,v,w,x,n,i0,i1,l,b,nb,mask,left,nt,pass,npass,*list,*hkey,*nu;
+	size_t j,j1;
+	unsigned char *q;
+	unsigned long long est,wedges,cands,pairs;
+	double t0,kth;
+	bool full=(prm->topk>0);//top-k mode: both sides of each pair
+	unsigned hashmax=(prm->hashmax<g->n/256)?prm->hashmax:g->n/256;
+	double val[NVAL(METRIC)];
+#if PRUNE && !WEIGHTED(METRIC)
+	double r=BOUND(METRIC)(prm->a);//smallest degree ratio of a pair
+#endif
+	unsigned long long *hist_p,*hist=calloc(10*NVAL(METRIC),sizeof(unsigned long long));
+	unsigned nth=omp_get_max_threads();
+	unsigned long long **hists=calloc(nth,sizeof(unsigned long long*)),**fcs=calloc(nth,sizeof(unsigned long long*));
+	bool hashed,below;
+	ACC *inter,*hval,wv,c;
+	accum acc;
+	task *tk;
+	splitsource *sp;
+	pairfile *pf;
+	#pragma omp parallel private(i,j,j1,k,t,p,u,v,w,x,n,i0,i1,l,b,nb,mask,left,nt,pass,npass,list,hkey,nu,q,est,wedges,cands,pairs,t0,kth,val,hist_p,hashed,below,inter,hval,wv,c,acc,tk,sp,pf)
+	{
+#if PRUNE
+	size_t j0;//position of u in the list of v
+	bool above;//the nodes w>u are traversed in this pass
+#endif
+#if PRUNE && !WEIGHTED(METRIC)
+	double rb;//smallest degree ratio of the nodes w<u in top-k mode
+#endif
+#if PRUNE && WEIGHTED(METRIC)
+	double wu;
+#endif
+	unsigned *ubuf=NULL,usize=0;//decoded neighbors of u if compressed
+	scored *top=full?malloc(prm->topk*sizeof(scored)):NULL;//best partners of u in top-k mode
+	unsigned long long *fc=(prm->fine!=NULL)?calloc(prm->fine->len,sizeof(unsigned long long)):NULL;//finer statistics of the thread
+	hist_p=calloc(10*NVAL(METRIC),sizeof(unsigned long long));
+	pf=(prm->prefix!=NULL)?openpairs(prm->prefix,omp_get_thread_num(),prm->text,NVAL(METRIC),prm->append):NULL;
+	initaccum(&acc,sizeof(ACC));
+	wedges=0;
+	cands=0;
+	pairs=0;
+	t0=now();
+
+	#pragma omp for schedule(dynamic, 1) nowait
+	for (t=0;t<s->ntasks;t++){//tasks of about the same cost, see mkschedule
+		tk=s->tasks+t;
+		sp=(tk->split!=NONE)?s->splits+tk->split:NULL;
+		for (u=tk->u;u<tk->last;u++){
+			//neighbors nu[i0..i1[ of u
+			nu=neighbors(g,u,&ubuf,&usize);
+			i0=(sp!=NULL)?tk->i0-listoff(g,u):0;
+			i1=(sp!=NULL)?tk->i1-listoff(g,u):listlen(g,u);
+#if PRUNE && WEIGHTED(METRIC)
+			//the similarity of u and any node is at most the sum of the weights of the neighbors of u
+			wu=0;
+			for (i=0;i<listlen(g,u);i++){
+				v=nu[i];
+#if NOHUB
+				if (g->d0[v]>prm->dmax)
+					continue;
+#endif
+				wu+=g->wt[v];
+			}
+			if (wu<prm->a)
+				continue;//all the parts of a split source skip it
+#endif
+			//2-hop estimate: upper bound on the number of nodes w
+			est=0;
+			for (i=i0;i<i1;i++){
+				v=nu[i];
+#if NOHUB
+				if (g->d0[v]>prm->dmax)
+					continue;
+#endif
+				est+=listlen(g,v);
+			}
+			if (est==0 && sp==NULL)
+				continue;
+			nt=0;
+			kth=prm->a;
+			//top-k mode: the nodes w<u of an unsplit source in a second pass, pruned with the k-th best similarity
+			npass=1;
+#if PRUNE && !WEIGHTED(METRIC)
+			if (full && sp==NULL)
+				npass=2;
+#endif
+			for (pass=0;pass<npass;pass++){
+#if PRUNE
+				above=(pass==0);
+#endif
+				below=full && (npass==1 || pass==1);
+#if PRUNE && !WEIGHTED(METRIC)
+				//at least r, with a margin for the rounding: a node of similarity equal to the k-th best one still
+				//enters the heap if its label is smaller
+				rb=BOUND(METRIC)(kth)*(1.-1e-9);
+				rb=(rb>r)?rb:r;
+#endif
+				//small 2-hop neighborhoods in a hash table, large ones in dense arrays
+				hashed=(est<=hashmax);
+				mask=prepareaccum(&acc,g->n,est,hashed);
+				list=acc.list;
+				inter=acc.inter;
+				hkey=acc.key;
+				hval=acc.val;
+				n=0;
+				for (i=i0;i<i1;i++){
+					v=nu[i];
+#if NOHUB
+					if (g->d0[v]>prm->dmax)
+						continue;
+#endif
+#if WEIGHTED(METRIC)
+					wv=g->wt[v];
+#else
+					wv=1;
+#endif
+					if (g->cadj!=NULL){
+						//decode the neighbors w of v on the fly, block by block (see compress)
+#if PRUNE
+						b=below?0:findblock(g,v,u);
+#else
+						b=0;
+#endif
+						for (nb=nblocks(g,v);b<nb;b++){
+							q=blockstart(g,v,b,&l);
+							for (j=0;j<l;j++){
+								q=getvarint(q,&x);
+#if PRUNE
+								w=(j>0)?w+x:x;
+								if (w<=u){
+#if !WEIGHTED(METRIC)
+									if (!below || w==u || ((double)g->d[w])/((double)(g->d[u]))<rb){
+#else
+									if (!below || w==u){
+#endif
+										continue;
+									}
+									wedges++;
+									ADD(w,wv)
+									continue;
+								}
+								if (!above)
+									break;
+#if !WEIGHTED(METRIC)
+								if (((double)g->d[u])/((double)(g->d[w]))<r){
+									break;
+								}
+#endif
+#else
+								w=(j>0)?w-x:x;
+								if (w==u){
+									if (!below)
+										break;
+									continue;
+								}
+#endif
+								wedges++;
+								ADD(w,wv)
+							}
+							if (j<l)
+								break;
+						}
+						continue;
+					}
+					j1=listoff(g,v+1);
+#if PRUNE
+					j0=binsearch(g->adj,listoff(g,v),j1-1,u);
+					if (below){
+						//the nodes w<u, by decreasing degree
+						for (j=j0-1;j>listoff(g,v);j--){
+							w=g->adj[j-1];
+#if !WEIGHTED(METRIC)
+							if (((double)g->d[w])/((double)(g->d[u]))<rb){
+								break;
+							}
+#endif
+							wedges++;
+							ADD(w,wv)
+						}
+					}
+					if (!above)
+						continue;
+					for (j=j0;j<j1;j++){
+						w=g->adj[j];
+#if !WEIGHTED(METRIC)
+						if (((double)g->d[u])/((double)(g->d[w]))<r){
+							break;
+						}
+#endif
+#else
+					for (j=listoff(g,v);j<j1;j++){
+						w=g->adj[j];
+						if (w==u){//make sure that (u,w) is processed only once (out-neighbors of u are sorted in decreasing order)
+							if (!below)
+								break;
+							continue;
+						}
+#endif
+						wedges++;
+						//hashed is the same for the whole loop, which the compiler unswitches
+						ADD(w,wv)
+					}
+				}
+				if (sp!=NULL){
+					//export the counters of this part, the last part merges them all
+					sp->len[tk->part]=n;
+					sp->w[tk->part]=malloc(n*sizeof(unsigned));
+					sp->c[tk->part]=malloc(n*sizeof(ACC));
+					for (i=0;i<n;i++){
+						TAKE(i)
+						sp->w[tk->part][i]=w;
+						((ACC*)sp->c[tk->part])[i]=c;
+					}
+					#pragma omp atomic capture seq_cst
+					left=--sp->left;
+					if (left>0)
+						continue;
+					est=0;
+					for (p=0;p<sp->nparts;p++)
+						est+=sp->len[p];
+					hashed=(est<=hashmax);
+					mask=prepareaccum(&acc,g->n,est,hashed);
+					list=acc.list;
+					inter=acc.inter;
+					hkey=acc.key;
+					hval=acc.val;
+					n=0;
+					for (p=0;p<sp->nparts;p++){
+						for (i=0;i<sp->len[p];i++){
+							w=sp->w[p][i];
+							ADD(w,((ACC*)sp->c[p])[i])
+						}
+						free(sp->w[p]);
+						free(sp->c[p]);
+					}
+				}
+				cands+=n;
+				for (i=0;i<n;i++){
+					TAKE(i)
+					EVAL(METRIC)(val,c,g->d[u],g->d[w]);
+					if (full && val[0]>=kth){
+						//the current k-th best similarity skips most candidates without touching the heap
+						pushtopk(top,&nt,prm->topk,w,nodeid(g,w),val[0],c);
+						if (nt==prm->topk)
+							kth=top[0].val;
+					}
+					if (w<u)
+						continue;//other side, top-k mode only
+					for (k=0;k<NVAL(METRIC);k++){
+						if (val[k]>0.9){
+							hist_p[10*k+9]++;
+						}
+						else {
+							hist_p[10*k+(int)(floor(val[k]*10))]++;
+						}
+					}
+					if (fc!=NULL){
+						addfine(prm->fine,fc,val,g->d[u],g->d[w]);
+					}
+					if (pf!=NULL && !full && val[0]>=prm->a){
+						writepair(pf,nodeid(g,u),nodeid(g,w),val);
+						pairs++;
+					}
+				}
+			}
+			if (pf!=NULL && nt>0){
+				sorttopk(top,nt);
+				for (i=0;i<nt;i++){
+					EVAL(METRIC)(val,top[i].c,g->d[u],g->d[top[i].node]);
+					writepair(pf,nodeid(g,u),nodeid(g,top[i].node),val);
+				}
+				pairs+=nt;
+			}
+		}
+	}
+	//summed over the passes of an out-of-core run
+	th[omp_get_thread_num()].busy+=now()-t0;
+	th[omp_get_thread_num()].wedges+=wedges;
+	th[omp_get_thread_num()].cands+=cands;
+	th[omp_get_thread_num()].pairs+=pairs;
+	if (acc.bytes>th[omp_get_thread_num()].scratch)
+		th[omp_get_thread_num()].scratch=acc.bytes;
+	freeaccum(&acc);
+	free(ubuf);
+	free(top);
+	if (pf!=NULL){
+		closepairs(pf);
+	}
+	hists[omp_get_thread_num()]=hist_p;
+	fcs[omp_get_thread_num()]=fc;
+	}
+	//the copies of the threads are added once they are all done, without critical section
+	for (p=0;p<nth;p++){
+		if (hists[p]==NULL)
+			continue;
+		for (i=0;i<10*NVAL(METRIC);i++){
+			hist[i]+=hists[p][i];
+		}
+		free(hists[p]);
+	}
+	if (prm->fine!=NULL){
+		mergefine(prm->fine,fcs,nth);
+	}
+	free(hists);
+	free(fcs);
+	return hist;
+}
+
+#undef ACC
+#undef ADD
+#undef TAKE
+
+#endif
@@ -0,0 +1,512 @@
+/*
+Approximate threshold join (neighsim -l k): the pairs of jaccard or cosine similarity of at least a,
+found by locality-sensitive hashing in time about linear in the number of edges, instead of traversing all the wedges.
+
+Each node gets k MinHash values of its set of neighbors (of degree smaller or equal to dmax), in parallel over
+the lists, with one permutation hashing: each neighbor is hashed once in one of k bins keeping its smallest hash,
+each empty bin taking the value of the first full one in a random order of the bins of its own, the same for all
+nodes (optimal densification). Two nodes have the same value in a bin with a probability of their jaccard similarity.
+The k values are cut in b bands of r rows: two nodes are a candidate pair if all the rows of one of the bands
+are equal, i.e. with a probability of 1-(1-s^r)^b for a jaccard similarity s. r is the largest one for which
+a pair of jaccard similarity t is a candidate with a probability of at least LSHTARGET: t=a for jaccard, and
+t=a^2 for cosine, the smallest jaccard similarity of two sets of cosine similarity a (degrees in a ratio of a^2).
+The nodes of each band are sorted by the hash of their rows, each group of equal hashes giving its pairs, which are
+only taken in the first band where they meet. The pairs beyond the degree ratio bound of the metric are dropped,
+the others are verified by intersecting their lists with -v (see join.h), else estimated from a signature:
+- jaccard: 8 bits of each MinHash value (b-bit MinHash), equal with a probability of s+(1-s)/256
+- cosine: SimHash, the signs of the sums of k random +1/-1 per neighbor, two nodes having the same bit with
+  a probability of 1-theta/pi, where cos(theta) is their cosine similarity
+SimHash is not used for the bands: two nodes without common neighbor (most pairs) have half of their bits equal,
+which would make far too many candidates.
+If only bands of one row reach LSHTARGET, the run is refused: about every pair with a common neighbor would be
+a candidate, and the smallest k giving bands of two rows is suggested.
+The recall expected from the curve above is printed, times the probability for the estimate of a pair to be at
+least a (binomial tail of its k values, about 1/2 at a) unless verified, and the recall and precision are measured
+on a sample of LSHSAMPLE nodes against their exact similarities.
+*/
+
+#ifndef LSH_H
+#define LSH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "engine.h"
+#include "server.h"
+
+
+#define LSHSEED 0x2545f4914f6cdd1dULL //seed of the hash functions
+#define LSHTARGET 0.9 //probability for a pair of similarity a to be a candidate
+#define LSHSAMPLE 1000 //nodes whose recall and precision are measured
+#define LSHMAX 4096 //largest number of hashes per node
+
+typedef struct {
+	unsigned long long key;//hash of the rows of a band
+	unsigned node;
+} bandkey;
+
+typedef struct {
+	unsigned jac;//signatures of MinHash values (jaccard), else of SimHash bits (cosine)
+	unsigned k;//hashes per node
+	double t;//jaccard similarity of the pairs found with a probability of at least LSHTARGET
+	unsigned r;//rows per band
+	unsigned b;//bands
+	size_t sbytes;//bytes of the signature of a node
+	unsigned char *sig;//signature of node u at sig+u*sbytes
+	unsigned long long *key;//hash of band i of node u at key[u*b+i]
+	bool *has;//nodes with a neighbor (of degree smaller or equal to dmax)
+} lsh;
+
+int compare_bandkey(void const *a,void const *b){
+	bandkey const *x=a,*y=b;
+	if (x->key!=y->key)
+		return (x->key<y->key)?-1:1;
+	return (x->node<y->node)?-1:(x->node>y->node);
+}
+
+//probability that two nodes of jaccard similarity s are a candidate pair
+double candprob(lsh *l,double s){
+	return 1.-pow(1.-pow(s,l->r),l->b);
+}
+
+//rows per band: the largest r giving a candidate probability of at least LSHTARGET at t
+//false if only bands of one row do: any single equal value makes a candidate, about every pair with a common neighbor
+bool tunebands(lsh *l){
+	unsigned r;
+	for (r=l->k;r>1;r--){
+		l->r=r;
+		l->b=l->k/r;
+		if (candprob(l,l->t)>=LSHTARGET)
+			return 1;
+	}
+	l->r=1;
+	l->b=l->k;
+	return 0;
+}
+
+//order of the bins of each empty bin j in perm[j*k..(j+1)*k[, and the position of bin b in it in pos[j*k+b]
+void densorder(unsigned k,unsigned short *perm,unsigned short *pos){
+	unsigned j,t,x;
+	unsigned short y;
+	for (j=0;j<k;j++){
+		for (t=0;t<k;t++)
+			perm[j*k+t]=t;
+		for (t=k-1;t>0;t--){
+			x=mix64(((unsigned long long)j<<32|t)^LSHSEED)%(t+1);
+			y=perm[j*k+t];
+			perm[j*k+t]=perm[j*k+x];
+			perm[j*k+x]=y;
+		}
+		for (t=0;t<k;t++)
+			pos[j*k+perm[j*k+t]]=t;
+	}
+}
+
+//signature and band keys of each node
+lsh* mklsh(graph *g,int jac,unsigned k,double a,unsigned dmax){
+	lsh *l=malloc(sizeof(lsh));
+	unsigned short *perm=NULL,*pos=NULL;
+	unsigned u;
+
+	l->jac=jac;
+	l->k=k;
+	l->t=jac?a:a*a;
+	tunebands(l);
+	l->sbytes=jac?k:k/8;
+	l->sig=malloc(g->n*l->sbytes);
+	l->key=malloc((size_t)g->n*l->b*sizeof(unsigned long long));
+	l->has=calloc(g->n,sizeof(bool));
+	perm=malloc((size_t)k*k*sizeof(unsigned short));
+	pos=malloc((size_t)k*k*sizeof(unsigned short));
+	densorder(k,perm,pos);
+
+	#pragma omp parallel
+	{
+	unsigned *buf=NULL,size=0,*nu,i,j,t,d,f,b,v;
+	unsigned *mins=malloc(k*sizeof(unsigned)),*row=malloc(k*sizeof(unsigned)),*fl=malloc(k*sizeof(unsigned));
+	int *sum=malloc(k*sizeof(int));
+	bool *full=malloc(k*sizeof(bool));
+	unsigned long long h=0,key;
+	unsigned char *s;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<g->n;u++){
+		nu=neighbors(g,u,&buf,&size);
+		s=l->sig+u*l->sbytes;
+		bzero(full,k*sizeof(bool));
+		bzero(sum,k*sizeof(int));
+		for (i=0,d=0;i<listlen(g,u);i++){
+			v=nu[i];
+			if (g->d0[v]>dmax)
+				continue;
+			d++;
+			h=mix64(v^LSHSEED);
+			j=((h>>32)*k)>>32;
+			if (!full[j] || (unsigned)h<mins[j])
+				mins[j]=h;
+			full[j]=1;
+			if (!jac){
+				for (j=0;j<k;j++){
+					if (j%64==0)
+						h=mix64((((unsigned long long)v)<<8^(j/64))^LSHSEED);
+					sum[j]+=((h>>(j%64))&1)?1:-1;
+				}
+			}
+		}
+		if (d==0)
+			continue;
+		l->has[u]=1;
+		for (j=0,f=0;j<k;j++){
+			if (full[j])
+				fl[f++]=j;
+		}
+		//empty bin j: the first full bin in its order, among the f full ones if they are few, else along the order
+		for (j=0;j<k;j++){
+			if (full[j]){
+				row[j]=mins[j];
+			}
+			else if ((unsigned long long)f*f<k){
+				for (i=1,b=fl[0];i<f;i++)
+					b=(pos[j*k+fl[i]]<pos[j*k+b])?fl[i]:b;
+				row[j]=mins[b];
+			}
+			else {
+				for (t=0;!full[perm[j*k+t]];t++);
+				row[j]=mins[perm[j*k+t]];
+			}
+		}
+		if (jac){
+			for (j=0;j<k;j++)
+				s[j]=row[j];
+		}
+		else {
+			bzero(s,l->sbytes);
+			for (j=0;j<k;j++)
+				s[j/8]|=(sum[j]>0)<<(j%8);
+		}
+		for (i=0;i<l->b;i++){
+			for (j=i*l->r,key=i;j<(i+1)*l->r;j++)
+				key=mix64(key^row[j]);
+			l->key[(size_t)u*l->b+i]=key;
+		}
+	}
+	free(buf);
+	free(mins);
+	free(row);
+	free(fl);
+	free(sum);
+	free(full);
+	}
+	free(perm);
+	free(pos);
+	return l;
+}
+
+void freelsh(lsh *l){
+	free(l->sig);
+	free(l->key);
+	free(l->has);
+	free(l);
+}
+
+//similarity estimated from m equal 8-bit MinHash values (jaccard) or m different SimHash bits (cosine) out of k
+double estof(lsh *l,unsigned m){
+	double p;
+	if (l->jac){
+		//8-bit values are also equal by chance with a probability of 1/256
+		p=((double)m/l->k-1./256.)/(1.-1./256.);
+		return (p>0)?p:0.;
+	}
+	return cos(M_PI*m/l->k);
+}
+
+//similarity of u and w estimated from their signatures
+double estimate(lsh *l,unsigned u,unsigned w){
+	unsigned char *x=l->sig+u*l->sbytes,*y=l->sig+w*l->sbytes;
+	unsigned j,m=0;
+	if (l->jac){
+		for (j=0;j<l->k;j++)
+			m+=(x[j]==y[j]);
+		return estof(l,m);
+	}
+	for (j=0;j<l->sbytes;j++)
+		m+=__builtin_popcount(x[j]^y[j]);
+	return estof(l,m);
+}
+
+//probability that the estimate of a pair of similarity s is at least a: binomial tail of the k values,
+//equal with a probability of s+(1-s)/256 (jaccard), or bits different with a probability of acos(s)/pi (cosine)
+double estprob(lsh *l,double s,double a){
+	double q=l->jac?s+(1.-s)/256.:acos(s)/M_PI,p=0;
+	unsigned m;
+	for (m=0;m<=l->k;m++){
+		if (estof(l,m)<a)
+			continue;
+		if (q<=0 || q>=1)
+			p+=(m==((q<=0)?0:l->k));
+		else
+			p+=exp(lgamma(l->k+1.)-lgamma(m+1.)-lgamma(l->k-m+1.)+m*log(q)+(l->k-m)*log(1.-q));
+	}
+	return (p<1)?p:1.;
+}
+
+//probability that a pair of similarity s (jaccard or cosine, at least s^2 in jaccard) is found: a candidate,
+//and estimated at least a unless verified
+double foundprob(lsh *l,double s,double a,bool verify){
+	return candprob(l,l->jac?s:s*s)*(verify?1.:estprob(l,s,a));
+}
+
+//true if u and w have equal keys in a band before band i
+static inline bool metbefore(lsh *l,unsigned u,unsigned w,unsigned i){
+	unsigned j;
+	for (j=0;j<i;j++){
+		if (l->key[(size_t)u*l->b+j]==l->key[(size_t)w*l->b+j])
+			return 1;
+	}
+	return 0;
+}
+
+//exact common neighbors of u and w, or less than o if they are less than o
+unsigned exactcount(graph *g,unsigned u,unsigned w,unsigned o,unsigned dmax,unsigned **ubuf,unsigned *usize,unsigned **wbuf,unsigned *wsize){
+	unsigned *nu=neighbors(g,u,ubuf,usize),*nw=neighbors(g,w,wbuf,wsize);
+	if (dmax!=NODMAX)
+		return mergecount(g,nu,listlen(g,u),nw,listlen(g,w),o,dmax);
+	return intersectcount(nu,listlen(g,u),nw,listlen(g,w),o);
+}
+
+//the pairs of the candidates of all bands, in prm->prefix.<thread> and in the histogram
+//the pairs of the sampled nodes are kept in *found (sampled node, other node), *nfound of them
+unsigned long long* lshpairs(graph *g,lsh *l,params *prm,bool *sampled,unsigned long long **found,size_t *nfound,threadstats *th){
+	metricinfo *mi=metrics+prm->metric;
+	unsigned long long *hist=calloc(10,sizeof(unsigned long long));
+	double r=mi->bound(prm->a);
+	unsigned i,u,n=0;
+	bandkey *nodes;
+
+	for (u=0;u<g->n;u++)
+		n+=l->has[u];
+	nodes=malloc((size_t)n*sizeof(bandkey));//filled by each band in turn
+	*found=NULL;
+	*nfound=0;
+
+	#pragma omp parallel private(i,u)
+	{
+	unsigned long long *hist_p=calloc(10,sizeof(unsigned long long)),cands=0,pairs=0,*fnd=NULL;
+	unsigned *ubuf=NULL,usize=0,*wbuf=NULL,wsize=0,w,du,dw,c,o,p=omp_get_thread_num();
+	size_t lo,hi,x,y,nf=0,fmax=0,j;
+	double val[MAXVAL],t0=now();
+	pairfile *pf=(prm->prefix!=NULL)?openpairs(prm->prefix,p,prm->text,1,prm->append):NULL;
+	for (i=0;i<l->b;i++){
+		#pragma omp single
+		{
+		for (u=0,j=0;u<g->n;u++){
+			if (l->has[u]){
+				nodes[j].key=l->key[(size_t)u*l->b+i];
+				nodes[j++].node=u;
+			}
+		}
+		qsort(nodes,n,sizeof(bandkey),compare_bandkey);
+		}
+		//groups of equal keys, each one taken by the thread of its first node
+		#pragma omp for schedule(dynamic, 1024)
+		for (x=0;x<n;x++){
+			if (x>0 && nodes[x-1].key==nodes[x].key)
+				continue;
+			for (lo=x,hi=x+1;hi<n && nodes[hi].key==nodes[lo].key;hi++);
+			for (y=lo;y<hi;y++){
+				u=nodes[y].node;
+				for (j=y+1;j<hi;j++){
+					w=nodes[j].node;
+					if (metbefore(l,u,w,i))
+						continue;
+					cands++;
+					du=g->d[u];
+					dw=g->d[w];
+					if (((du<dw)?(double)du/dw:(double)dw/du)<r)
+						continue;
+					if (prm->verify){
+						o=minoverlap(l->jac?overlap_jaccard(prm->a,du,dw):overlap_cosine(prm->a,du,dw));
+						if ((c=exactcount(g,u,w,o,prm->dmax,&ubuf,&usize,&wbuf,&wsize))<o)
+							continue;
+						mi->eval(val,c,du,dw);
+					}
+					else {
+						val[0]=estimate(l,u,w);
+					}
+					if (val[0]<prm->a)
+						continue;
+					hist_p[bucket(val[0])]++;
+					if (pf!=NULL){
+						writepair(pf,nodeid(g,u),nodeid(g,w),val);
+						pairs++;
+					}
+					if (sampled[u] || sampled[w]){
+						if (nf+2>fmax){
+							fmax=(fmax>0)?2*fmax:1024;
+							fnd=realloc(fnd,fmax*sizeof(unsigned long long));
+						}
+						if (sampled[u])
+							fnd[nf++]=((unsigned long long)u<<32)|w;
+						if (sampled[w])
+							fnd[nf++]=((unsigned long long)w<<32)|u;
+					}
+				}
+			}
+		}
+	}
+	th[p].busy+=now()-t0;
+	th[p].cands+=cands;
+	th[p].pairs+=pairs;
+	if (pf!=NULL)
+		closepairs(pf);
+	free(ubuf);
+	free(wbuf);
+	#pragma omp critical
+	{
+		for (i=0;i<10;i++)
+			hist[i]+=hist_p[i];
+		*found=realloc(*found,(*nfound+nf)*sizeof(unsigned long long));
+		memcpy(*found+*nfound,fnd,nf*sizeof(unsigned long long));
+		*nfound+=nf;
+	}
+	free(hist_p);
+	free(fnd);
+	}
+	free(nodes);
+	return hist;
+}
+
+//recall and precision on the sampled nodes: the pairs found with an exact similarity of at least a
+//over all their pairs with an exact similarity of at least a, and over the pairs found
+void measure(graph *g,params *prm,bool *sampled,unsigned long long *found,size_t nfound,double *recall,double *precision,unsigned long long *nexact){
+	metricinfo *mi=metrics+prm->metric;
+	server *sv=mkserver(g,prm->dmax,prm->hashmax);
+	unsigned long long tp=0,ne=0;
+	size_t i;
+	unsigned u;
+
+	#pragma omp parallel reduction(+:tp,ne)
+	{
+	worker wk;
+	unsigned *ubuf=NULL,usize=0,*wbuf=NULL,wsize=0,w,c;
+	double val[MAXVAL];
+	initworker(&wk);
+	#pragma omp for schedule(dynamic, 1)
+	for (u=0;u<g->n;u++){
+		if (sampled[u])
+			ne+=similar(sv,&wk,mi,u,0,prm->a);
+	}
+	#pragma omp for schedule(dynamic, 1024)
+	for (i=0;i<nfound;i++){
+		u=found[i]>>32;
+		w=found[i]&UINT_MAX;
+		c=exactcount(g,u,w,0,prm->dmax,&ubuf,&usize,&wbuf,&wsize);
+		mi->eval(val,c,g->d[u],g->d[w]);
+		tp+=(val[0]>=prm->a);
+	}
+	freeworker(&wk);
+	free(ubuf);
+	free(wbuf);
+	}
+	freeserver(sv);
+	*recall=(ne>0)?(double)tp/ne:1.;
+	*precision=(nfound>0)?(double)tp/nfound:1.;
+	*nexact=ne;
+}
+
+//approximate run: read/build the graph with degree ordering, hash, join, print
+int lshrun(params *prm,char *input){
+	metricinfo *mi=metrics+prm->metric;
+	int jac=(strcmp(mi->name,"jaccard")==0);
+	graph *g;
+	lsh *l,tl;
+	runstats st;
+	unsigned long long *hist,*found,nexact,ncands;
+	size_t nfound;
+	bool *sampled;
+	unsigned u,step;
+	double t0,t1,recall,precision,mean;
+	t1=now();
+	t0=t1;
+
+	if ((!jac && strcmp(mi->name,"cosine")!=0) || prm->a<=0 || prm->a>1){
+		fprintf(stderr,"Approximate join for jaccard or cosine with 0<a<=1\n");
+		return 1;
+	}
+	if (prm->join || prm->topk>0 || prm->budget>0 || prm->nshards>1 || prm->batch!=NULL || prm->dir!=DIR_NONE){
+		fprintf(stderr,"Approximate join in memory, without -x, -k, -M, -P, -u or -D\n");
+		return 1;
+	}
+	if (prm->lsh<8 || prm->lsh>LSHMAX || (!jac && prm->lsh%8!=0)){
+		fprintf(stderr,"Approximate join with 8 to %u hashes, a multiple of 8 for cosine\n",LSHMAX);
+		return 1;
+	}
+	//bands of one row would make about every pair with a common neighbor a candidate: as slow as the exact join
+	tl.k=prm->lsh;
+	tl.t=jac?prm->a:prm->a*prm->a;
+	if (!tunebands(&tl)){
+		for (tl.k*=2;tl.k<=LSHMAX && !tunebands(&tl);tl.k*=2);
+		if (tl.k<=LSHMAX)
+			fprintf(stderr,"With %u hashes, a pair of jaccard similarity %g needs bands of 1 row to be a candidate with a probability of %g: use -l %u or more\n",prm->lsh,tl.t,LSHTARGET,tl.k);
+		else
+			fprintf(stderr,"Even with %u hashes, a pair of jaccard similarity %g needs bands of 1 row to be a candidate with a probability of %g: use the exact join\n",LSHMAX,tl.t,LSHTARGET);
+		return 1;
+	}
+	initstats(&st,omp_get_max_threads());
+	st.input=input;
+	st.metric=mi->name;
+	st.a=prm->a;
+	st.dmax=prm->dmax;
+	printf("Similarities greater than: %g\n",prm->a);
+	if (prm->dmax!=NODMAX){
+		printf("Only taking into account common neighbors with degree <= %u\n",prm->dmax);
+	}
+
+	g=loadgraph(prm,input,NULL,&t1,&st);
+	if (g==NULL){
+		freestats(&st);
+		return 1;
+	}
+	st.n=g->n;
+	st.e=g->e;
+	printtime(&t1);
+
+	printf("Hashing the neighbors: MinHash with %u bins%s\n",prm->lsh,jac?"":", SimHash with as many bits");
+	l=mklsh(g,jac,prm->lsh,prm->a,prm->dmax);
+	for (u=0,mean=0;u<100;u++)
+		mean+=candprob(l,l->t+(1.-l->t)*(u+0.5)/100)/100;
+	printf("%u bands of %u rows: a pair of jaccard similarity %g is a candidate with a probability of %.3f, %.3f on average over [%g, 1], %.3f at %g\n",l->b,l->r,l->t,candprob(l,l->t),mean,l->t,candprob(l,l->t/2),l->t/2);
+	for (u=0,mean=0;u<100;u++)
+		mean+=foundprob(l,prm->a+(1.-prm->a)*(u+0.5)/100,prm->a,prm->verify)/100;
+	printf("Expected recall%s: %.3f at a similarity of %g, %.3f on average over [%g, 1]\n",prm->verify?"":" (candidates estimated at least a)",foundprob(l,prm->a,prm->a,prm->verify),prm->a,mean,prm->a);
+	endphase(&st,PH_BUILD);
+	printtime(&t1);
+
+	printf("Computing %s similarities (%s)\n",mi->desc,prm->verify?"candidates verified":"estimated");
+	if (prm->prefix!=NULL){
+		printf("Writing pairs in files %s.<thread>\n",prm->prefix);
+	}
+	sampled=calloc(g->n,sizeof(bool));
+	for (u=0,step=(g->n>LSHSAMPLE)?g->n/LSHSAMPLE:1;u<g->n;u+=step)
+		sampled[u]=1;
+	hist=lshpairs(g,l,prm,sampled,&found,&nfound,st.th);
+	endphase(&st,PH_COMPUTE);
+	for (u=0,ncands=0;u<st.nthreads;u++)
+		ncands+=st.th[u].cands;
+	printf("Candidate pairs: %llu\n",ncands);
+	printtime(&t1);
+
+	measure(g,prm,sampled,found,nfound,&recall,&precision,&nexact);
+	printf("On a sample of %u nodes (%llu pairs of similarity at least %g): recall %.4f, precision %.4f\n",(g->n+step-1)/step,nexact,prm->a,recall,precision);
+	printtime(&t1);
+
+	free(sampled);
+	free(found);
+	freelsh(l);
+	freegraph(g);
+
+	return endrun(prm,&st,hist,t0,t1);
+}
+
+#endif
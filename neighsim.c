@@ -0,0 +1,170 @@
+/*
+gcc neighsim.c -O9 -o neighsim -lm -fopenmp
+./neighsim [options] n_threads net.txt [net.bin]
+./neighsim [options] n_threads net.bin
+./neighsim -u batch [options] n_threads net.bin [new.bin]
+./neighsim -l k -a a [options] n_threads net.txt|net.bin
+./neighsim -e err|-T seconds [options] n_threads net.txt|net.bin
+
+Single entry point to the similarity engine (engine.h): the metric, the threshold and the
+hub filter select one of the kernels specialized at compile time, on the undirected graph or with -D on the
+out- or in-neighborhoods of a directed graph (see graph.h).
+With -u, only the changes made by a batch of edge insertions and deletions (see update.h),
+with -l, the pairs of similarity at least a found by locality-sensitive hashing (see lsh.h),
+with -e or -T, the histogram estimated from sampled sources (see sample.h).
+*/
+
+#include "engine.h"
+#include "update.h"
+#include "lsh.h"
+#include "sample.h"
+
+
+void usage(char *prog){
+	unsigned i;
+	fprintf(stderr,"%s [options] n_threads net.txt|net.bin [net.bin]\n",prog);
+	fprintf(stderr,"-m metric: similarity to compute, one of:");
+	for (i=0;i<NMETRICS;i++)
+		fprintf(stderr," %s",metrics[i].name);
+	fprintf(stderr," (default: all = cosine, jaccard and F1)\n");
+	fprintf(stderr,"-a a: only similarities greater than or equal to a (degree ordering and pruning)\n");
+	fprintf(stderr,"-x: with -a, exact threshold join: only the pairs with a similarity of at least a, with prefix filtering (cosine, jaccard, f1, hdi, see join.h)\n");
+	fprintf(stderr,"-l k: with -a, approximate join: the pairs found by MinHash (jaccard) or SimHash (cosine) with k hashes per node, LSH bands tuned to a (see lsh.h)\n");
+	fprintf(stderr,"-v: with -l, verify the candidates exactly instead of estimating them from the hashes\n");
+	fprintf(stderr,"-d dmax: only common neighbors with degree smaller or equal to dmax\n");
+	fprintf(stderr,"-o pairs: write the pairs in files pairs.<thread>\n");
+	fprintf(stderr,"-t: pairs in text instead of binary\n");
+	fprintf(stderr,"-k k: with -o, only the k most similar nodes of each node, best first (and of similarity at least a, see topk.h)\n");
+	fprintf(stderr,"-H hashmax: sources with a 2-hop estimate up to hashmax (and n/256) use a hash table instead of n-sized arrays (default %u, 0: never)\n",HASHMAX);
+	fprintf(stderr,"-r order: without degree ordering, relabel the nodes for locality, one of:");
+	for (i=1;i<NORDERS;i++)
+		fprintf(stderr," %s",ordnames[i]);
+	fprintf(stderr," (see order.h, kept in net.bin)\n");
+	fprintf(stderr,"-D out|in: directed graph, similarities of the out-neighborhoods (bibliographic coupling, sources of a bipartite graph) or of the in-neighborhoods (co-citation, targets), only among the nodes with such neighbors (see graph.h, kept in net.bin)\n");
+	fprintf(stderr,"-B bins: also count the pairs in these bins: edges \"e0,e1,...,ek\", \"lo:hi:n\" (n bins of the same width) or \"log:lo:hi:n\" (n logarithmic bins), see stats.h\n");
+	fprintf(stderr,"-Q: also print quantiles of the similarities (sketch with a relative error of %g)\n",1./(2<<SKSUB));
+	fprintf(stderr,"-S: also print the histogram of the first similarity by degree classes of the pairs\n");
+	fprintf(stderr,"-j report.json: write the phase times, per-thread counters and peak memory in report.json\n");
+	fprintf(stderr,"-z: compress the lists of neighbors (about 3 times less memory, kept in net.bin)\n");
+	fprintf(stderr,"-M megabytes: out of core, with at most this memory for the lists of neighbors (net.bin not compressed only, see ooc.h)\n");
+	fprintf(stderr,"-P processes: shard the sources between this number of processes of n_threads threads each (net.bin only, see shard.h), pairs in files pairs.<process>.<thread>\n");
+	fprintf(stderr,"-u batch: incremental update, the changes of the histogram and of the pairs (pairs.del.<thread>, pairs.add.<thread>) made by the edge insertions (+ u w) and deletions (- u w) of batch, the graph after it written in new.bin (see update.h)\n");
+	fprintf(stderr,"-b base.out: with -u, the output of the run before the batch, whose histogram is updated\n");
+	fprintf(stderr,"-e err: estimated histogram, from sources sampled until each bucket is known within this relative error at 95%% confidence (see sample.h)\n");
+	fprintf(stderr,"-T seconds: estimated histogram, from the sources sampled in this time (with -e, whichever comes first)\n");
+	fprintf(stderr,"net.bin after net.txt: write the built graph in binary and stop\n");
+	exit(1);
+}
+
+int main(int argc,char** argv){
+	params prm=defaultparams();
+	int c,m,sketch=0,strata=0;
+	char *bins=NULL;
+
+	while ((c=getopt(argc,argv,"m:a:d:o:tk:H:r:j:zM:P:xu:b:l:ve:T:D:B:QS"))!=-1) {
+		switch (c) {
+			case 'm':
+				if ((m=findmetric(optarg))<0)
+					usage(argv[0]);
+				prm.metric=m;
+				break;
+			case 'a':
+				prm.a=atof(optarg);
+				break;
+			case 'd':
+				prm.dmax=atoi(optarg);
+				break;
+			case 'o':
+				prm.prefix=optarg;
+				break;
+			case 't':
+				prm.text=1;
+				break;
+			case 'k':
+				if ((prm.topk=atoi(optarg))<1)
+					usage(argv[0]);
+				break;
+			case 'H':
+				prm.hashmax=atoi(optarg);
+				break;
+			case 'M':
+				prm.budget=(size_t)atol(optarg)<<20;
+				break;
+			case 'P':
+				if ((prm.nshards=atoi(optarg))<1)
+					usage(argv[0]);
+				break;
+			case 'x':
+				prm.join=1;
+				break;
+			case 'l':
+				if ((prm.lsh=atoi(optarg))<1)
+					usage(argv[0]);
+				break;
+			case 'v':
+				prm.verify=1;
+				break;
+			case 'e':
+				prm.eps=atof(optarg);
+				break;
+			case 'T':
+				prm.tmax=atof(optarg);
+				break;
+			case 'u':
+				prm.batch=optarg;
+				break;
+			case 'b':
+				prm.base=optarg;
+				break;
+			case 'z':
+				prm.cmp=1;
+				break;
+			case 'j':
+				prm.report=optarg;
+				break;
+			case 'B':
+				bins=optarg;
+				break;
+			case 'Q':
+				sketch=1;
+				break;
+			case 'S':
+				strata=1;
+				break;
+			case 'D':
+				if ((m=finddir(optarg))<1)
+					usage(argv[0]);
+				prm.dir=m;
+				break;
+			case 'r':
+				if ((m=findorder(optarg))<0)
+					usage(argv[0]);
+				prm.order=m;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc-optind<2)
+		usage(argv[0]);
+	if (bins!=NULL || sketch || strata){
+		if (prm.lsh>0 || prm.batch!=NULL || prm.eps!=0 || prm.tmax!=0 || prm.nshards>1){
+			fprintf(stderr,"Finer statistics (-B, -Q, -S) of the kernels in one process, without -l, -u, -e, -T or -P\n");
+			return 1;
+		}
+		if ((prm.fine=mkfine(metrics[prm.metric].nval,bins,sketch,strata))==NULL)
+			usage(argv[0]);
+	}
+	argc-=optind-1;
+	argv+=optind-1;
+
+	omp_set_num_threads(atoi(argv[1]));
+
+	if (prm.lsh>0)
+		return lshrun(&prm,argv[2]);
+	if (prm.eps!=0 || prm.tmax!=0)
+		return samplerun(&prm,argv[2]);
+	if (prm.batch!=NULL)
+		return updaterun(&prm,argv[2],(argc>3)?argv[3]:NULL);
+	return simrun(&prm,argv[2],(argc>3)?argv[3]:NULL);
+}
@@ -0,0 +1,374 @@
+/*
+Out-of-core computation, for graphs whose lists of neighbors do not fit in memory (neighsim -M).
+
+The graph is a binary graph file (see savebin, not compressed): cd, d0, d (and map) are used from it,
+but adj stays on disk. adj is cut in blocks of the same size, read in a mapping of the size of adj
+where only the loaded blocks take memory: OOCBLOCKS blocks, i.e. the memory budget, or fewer blocks of
+OOCMINBLOCK neighbors if the budget is small (at least 4).
+The sources are processed in passes: a pass is a list of tasks (see sched.h) whose 2-hop traversal
+only reads the blocks of the pass: the lists of the sources u and of their neighbors v. The blocks
+still needed by the next pass stay loaded.
+The sources are taken in windows of consecutive sources whose lists fill half of the blocks of a pass.
+adj is cut in chunks of the other half, and each source of a window in parts (ranges of its neighbors v,
+see mkschedule): those whose lists are in the window and those of one chunk. The parts are sorted by chunk,
+so that a pass is the lists of the window and a chunk: the window streams the lists of the chunks it needs,
+about 2*size(adj)/budget windows reading each up to 2*size(adj)/budget chunks on a graph without locality.
+With locality (see order.h), the neighbors of a window are mostly in the window, in one or two passes.
+The parts of a source are merged by the last one as for the hubs of mkschedule: their counters are kept
+until then, about the 2-hop neighbors of the sources of a window.
+The histograms of the passes are summed and the pairs are appended to the files of the threads.
+*/
+
+#ifndef OOC_H
+#define OOC_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "graph.h"
+#include "sched.h"
+
+
+#define OOCBLOCKS 16 //blocks in memory
+#define OOCMINBLOCK 4096 //smallest block in neighbors (16KB), unless a pass cannot hold 4 blocks
+
+typedef struct {
+	int fd;
+	off_t adjoff;//offset of adj in the file
+	size_t bsize;//number of neighbors in a block
+	unsigned nblk;
+	unsigned kmax;//blocks of a pass
+	unsigned nw;//words of a set of blocks
+	unsigned long long *loaded;//set of the loaded blocks
+	unsigned *area;//mapping of the size of adj
+	size_t arealen;
+	unsigned *win;//window of adj read during the planning: adj[wlo..whi[
+	size_t wlo;
+	size_t whi;
+	size_t wmax;
+	unsigned npasses;
+	unsigned *pass;//first task of each pass, pass[npasses]=ntasks
+	unsigned long long *blocks;//set of blocks of each pass, nw words each
+} ooc;
+
+//g is a binary graph mapped by loadbin: adj is replaced by an empty mapping, filled by loadblocks
+ooc* mkooc(graph *g,char *path,size_t budget){
+	ooc *o=calloc(1,sizeof(ooc));
+	size_t len=2*g->e;
+	long pg=sysconf(_SC_PAGESIZE);
+	uintptr_t a;
+
+	o->fd=open(path,O_RDONLY);
+	o->adjoff=(char*)g->adj-g->mm;
+	//the pages of adj read by filterdeg are not needed anymore
+	a=(uintptr_t)g->adj/pg*pg;
+	madvise((void*)a,(uintptr_t)(g->adj+len)-a,MADV_DONTNEED);
+
+	o->bsize=budget/sizeof(unsigned)/OOCBLOCKS;
+	if (o->bsize<OOCMINBLOCK)
+		o->bsize=(budget/sizeof(unsigned)/4<OOCMINBLOCK)?budget/sizeof(unsigned)/4:OOCMINBLOCK;
+	o->bsize=(o->bsize>1024)?o->bsize/1024*1024:1024;
+	o->kmax=budget/sizeof(unsigned)/o->bsize;
+	o->kmax=(o->kmax>4)?o->kmax:4;
+	o->nblk=(len+o->bsize-1)/o->bsize;
+	o->nw=(o->nblk+63)/64;
+	o->loaded=calloc(o->nw,sizeof(unsigned long long));
+	o->arealen=len*sizeof(unsigned);
+	o->area=mmap(NULL,o->arealen,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+	if (o->fd<0 || o->area==MAP_FAILED){
+		fprintf(stderr,"Cannot map the lists of neighbors of %s\n",path);
+		exit(1);
+	}
+	o->wmax=o->bsize;
+	o->win=malloc(o->wmax*sizeof(unsigned));
+	g->adj=o->area;
+	return o;
+}
+
+//read nb neighbors from adj[i] in p
+void readadj(ooc *o,size_t i,size_t nb,unsigned *p){
+	size_t k=0;
+	ssize_t r;
+	while (k<nb*sizeof(unsigned)) {
+		r=pread(o->fd,(char*)p+k,nb*sizeof(unsigned)-k,o->adjoff+i*sizeof(unsigned)+k);
+		if (r<=0){
+			perror("read adj");
+			exit(1);
+		}
+		k+=r;
+	}
+}
+
+//list of u read in the window, for the planning (u in increasing order)
+unsigned* readlist(ooc *o,graph *g,unsigned u){
+	size_t d=listlen(g,u);
+	if (listoff(g,u)<o->wlo || listoff(g,u+1)>o->whi){
+		if (d>o->wmax){
+			o->wmax=d;
+			free(o->win);
+			o->win=malloc(o->wmax*sizeof(unsigned));
+		}
+		o->wlo=listoff(g,u);
+		o->whi=o->wlo+o->wmax;
+		o->whi=(o->whi<2*g->e)?o->whi:2*g->e;
+		readadj(o,o->wlo,o->whi-o->wlo,o->win);
+	}
+	return o->win+(listoff(g,u)-o->wlo);
+}
+
+//part of a source of a window: its neighbors l[i0..i1[, whose lists are in the blocks of the window
+//or in the blocks h0..h1 of the chunk chunk-1 (chunk 0: only in the window)
+typedef struct {
+	unsigned u;
+	unsigned i0;
+	unsigned i1;
+	unsigned chunk;
+	unsigned h0;
+	unsigned h1;
+	unsigned long long cost;
+} oocpart;
+
+int compare_oocpart(void const *a,void const *b){
+	oocpart const *x=a,*y=b;
+	if (x->chunk!=y->chunk)
+		return (x->chunk<y->chunk)?-1:1;
+	if (x->u!=y->u)
+		return (x->u<y->u)?-1:1;
+	return (x->i0<y->i0)?-1:(x->i0>y->i0);
+}
+
+//number of blocks w0..w1 and b0..b1 not in set, added to set if add
+static inline unsigned newblocks(unsigned long long *set,unsigned w0,unsigned w1,unsigned b0,unsigned b1,bool add){
+	unsigned k,c=0;
+	for (k=(w0<b0)?w0:b0;k<=((w1>b1)?w1:b1);k++){
+		if ((k<w0 || k>w1) && (k<b0 || k>b1))
+			continue;
+		if ((set[k/64]>>(k%64))&1)
+			continue;
+		c++;
+		if (add)
+			set[k/64]|=1ULL<<(k%64);
+	}
+	return c;
+}
+
+//parts of the source u of the window of blocks w0..w1 (list l), appended to parts: a part ends when the list
+//of a neighbor is in another chunk, when the part costs target, or when it would not fit in a pass
+void cutparts(ooc *o,graph *g,unsigned u,unsigned *l,unsigned w0,unsigned w1,unsigned csize,unsigned long long target,unsigned dmax,oocpart **parts,unsigned *np,unsigned *qmax){
+	unsigned i,v,b0,b1,ch=0,own=w1-w0+1;
+	oocpart *p=NULL;
+	for (i=0;i<listlen(g,u);i++){
+		v=l[i];
+		if (g->d0[v]<=dmax && listlen(g,v)>0){
+			b0=listoff(g,v)/o->bsize;
+			b1=(listoff(g,v+1)-1)/o->bsize;
+			ch=(b0>=w0 && b1<=w1)?0:1+b0/csize;
+			if (ch>0 && own+b1-b0+1>o->kmax){
+				fprintf(stderr,"Memory budget too small for the lists of node %u and its neighbor %u\n",u,v);
+				exit(1);
+			}
+			if (p!=NULL && p->cost>=target)
+				p=NULL;
+			if (p!=NULL && ch>0 && p->chunk>0){
+				if (p->chunk!=ch || own+((p->h1>b1)?p->h1:b1)-((p->h0<b0)?p->h0:b0)+1>o->kmax)
+					p=NULL;
+			}
+		}
+		else
+			ch=0;
+		if (p==NULL){
+			if (*np==*qmax){
+				*qmax*=2;
+				*parts=realloc(*parts,*qmax*sizeof(oocpart));
+			}
+			p=*parts+(*np)++;
+			p->u=u;
+			p->i0=i;
+			p->chunk=0;
+			p->cost=0;
+		}
+		p->i1=i+1;
+		if (ch==0){
+			if (g->d0[v]<=dmax)
+				p->cost+=listlen(g,v);
+			continue;
+		}
+		if (p->chunk==0){
+			p->chunk=ch;
+			p->h0=b0;
+			p->h1=b1;
+		}
+		p->h0=(p->h0<b0)?p->h0:b0;
+		p->h1=(p->h1>b1)?p->h1:b1;
+		p->cost+=listlen(g,v);
+	}
+}
+
+static inline task* newtask(schedule *s,unsigned *tmax){
+	if (s->ntasks==*tmax){
+		*tmax*=2;
+		s->tasks=realloc(s->tasks,*tmax*sizeof(task));
+	}
+	return s->tasks+s->ntasks++;
+}
+
+//the current pass (set of blocks cur) ends before the next task
+void closepass(ooc *o,schedule *s,unsigned long long *cur,unsigned *pmax){
+	if (s->ntasks==o->pass[o->npasses])
+		return;
+	if (o->npasses+1==*pmax){
+		*pmax*=2;
+		o->pass=realloc(o->pass,(*pmax+1)*sizeof(unsigned));
+		o->blocks=realloc(o->blocks,*pmax*o->nw*sizeof(unsigned long long));
+	}
+	memcpy(o->blocks+(size_t)o->npasses*o->nw,cur,o->nw*sizeof(unsigned long long));
+	o->pass[++o->npasses]=s->ntasks;
+	bzero(cur,o->nw*sizeof(unsigned long long));
+}
+
+//tasks as in mkschedule, cut in passes of at most kmax blocks by windows and chunks, reading adj twice from the file
+schedule* mkpasses(graph *g,ooc *o,unsigned dmax,unsigned nthreads){
+	schedule *s=malloc(sizeof(schedule));
+	unsigned long long tot=0,target,cc=0,*cur=calloc(o->nw,sizeof(unsigned long long));
+	unsigned u,x,y,i,w0,w1,b0,b1,nb,ncur=0,np,*nparts,*split,tmax=1024,smax=16,pmax=16,qmax=1024;
+	unsigned wsize=o->kmax/2,csize=(o->kmax-wsize>2)?o->kmax-wsize-1:1;
+	bool open=false;
+	oocpart *parts=malloc(qmax*sizeof(oocpart)),*p;
+	splitsource *sp;
+	task *tk=NULL;
+
+	for (u=0;u<nsources(g);u++)
+		tot+=wedgecost(g,readlist(o,g,u),0,listlen(g,u),dmax);
+	o->wlo=o->whi=0;
+	target=tot/((unsigned long long)nthreads*TASKSPERTHREAD);
+	target=(target>MINTASKCOST)?target:MINTASKCOST;
+
+	s->ntasks=0;
+	s->tasks=malloc(tmax*sizeof(task));
+	s->nsplits=0;
+	s->splits=malloc(smax*sizeof(splitsource));
+	o->npasses=0;
+	o->pass=malloc((pmax+1)*sizeof(unsigned));
+	o->pass[0]=0;
+	o->blocks=malloc(pmax*o->nw*sizeof(unsigned long long));
+	for (u=0;u<nsources(g);u=x){
+		//window u..x-1: one source, and the next ones while their lists are in wsize blocks
+		for (x=u+1;x<nsources(g);x++){
+			if (listoff(g,x+1)>listoff(g,u) && (listoff(g,x+1)-1)/o->bsize-listoff(g,u)/o->bsize>=wsize)
+				break;
+		}
+		if (listoff(g,x)==listoff(g,u))
+			continue;
+		w0=listoff(g,u)/o->bsize;
+		w1=(listoff(g,x)-1)/o->bsize;
+		if (w1-w0+1>o->kmax){
+			fprintf(stderr,"Memory budget too small for the list of node %u\n",u);
+			exit(1);
+		}
+		np=0;
+		for (y=u;y<x;y++)
+			cutparts(o,g,y,readlist(o,g,y),w0,w1,csize,target,dmax,&parts,&np,&qmax);
+		qsort(parts,np,sizeof(oocpart),compare_oocpart);
+		nparts=calloc(x-u,sizeof(unsigned));
+		split=malloc((x-u)*sizeof(unsigned));
+		for (i=0;i<np;i++)
+			nparts[parts[i].u-u]++;
+		for (y=u;y<x;y++)
+			split[y-u]=NONE;
+		for (i=0;i<np;i++){
+			p=parts+i;
+			y=p->u;
+			b0=(p->chunk>0)?p->h0:w0;
+			b1=(p->chunk>0)?p->h1:w1;
+			nb=newblocks(cur,w0,w1,b0,b1,false);
+			if (ncur+nb>o->kmax){
+				closepass(o,s,cur,&pmax);
+				ncur=0;
+				open=false;
+			}
+			ncur+=newblocks(cur,w0,w1,b0,b1,true);
+			if (nparts[y-u]==1){
+				//whole source, in the task of the previous one while it costs less than target
+				if (!open || tk->last!=y || cc+p->cost>target){
+					tk=newtask(s,&tmax);
+					tk->u=y;
+					tk->split=NONE;
+					cc=0;
+					open=true;
+				}
+				tk->last=y+1;
+				cc+=p->cost;
+				continue;
+			}
+			//part of a split source, merged by its last part
+			if (split[y-u]==NONE){
+				if (s->nsplits==smax){
+					smax*=2;
+					s->splits=realloc(s->splits,smax*sizeof(splitsource));
+				}
+				split[y-u]=s->nsplits++;
+				s->splits[split[y-u]].nparts=0;
+			}
+			sp=s->splits+split[y-u];
+			tk=newtask(s,&tmax);
+			tk->u=y;
+			tk->last=y+1;
+			tk->split=split[y-u];
+			tk->part=sp->nparts++;
+			tk->i0=listoff(g,y)+p->i0;
+			tk->i1=listoff(g,y)+p->i1;
+			open=false;
+		}
+		for (y=u;y<x;y++){
+			if (split[y-u]==NONE)
+				continue;
+			sp=s->splits+split[y-u];
+			sp->left=sp->nparts;
+			sp->len=calloc(sp->nparts,sizeof(unsigned));
+			sp->w=calloc(sp->nparts,sizeof(unsigned*));
+			sp->c=calloc(sp->nparts,sizeof(void*));
+		}
+		free(nparts);
+		free(split);
+	}
+	closepass(o,s,cur,&pmax);
+	free(cur);
+	free(parts);
+	free(o->win);
+	o->win=NULL;
+	return s;
+}
+
+//load the blocks of the pass p and free the others
+void loadblocks(ooc *o,unsigned p){
+	unsigned long long *set=o->blocks+(size_t)p*o->nw;
+	size_t k,nb,len=o->arealen/sizeof(unsigned);
+	for (k=0;k<o->nblk;k++){
+		nb=(k+1<o->nblk)?o->bsize:len-k*o->bsize;
+		if ((set[k/64]>>(k%64))&1){
+			if (!((o->loaded[k/64]>>(k%64))&1))
+				readadj(o,k*o->bsize,nb,o->area+k*o->bsize);
+		}
+		else if ((o->loaded[k/64]>>(k%64))&1){
+			madvise(o->area+k*o->bsize,nb*sizeof(unsigned),MADV_DONTNEED);
+		}
+	}
+	memcpy(o->loaded,set,o->nw*sizeof(unsigned long long));
+}
+
+//g->adj is given back to freegraph as it was (in the mapped file)
+void freeooc(ooc *o,graph *g){
+	munmap(o->area,o->arealen);
+	g->adj=(unsigned*)(g->mm+o->adjoff);
+	close(o->fd);
+	free(o->loaded);
+	free(o->pass);
+	free(o->blocks);
+	free(o);
+}
+
+#endif
@@ -0,0 +1,247 @@
+/*
+Node orderings improving the locality of the wedge traversal (sim.c, sim_nohub.c).
+
+Without degree ordering, the kernel reads adj[cd[w]..] for all the 2-hop neighbors w of u, so that
+nodes reached from the same neighbors should have close labels. The ordering is computed on the
+neighborhoods built with the original labels (cd, adj, d0), it gives g->rank and the edge list is then
+relabeled (see relabel) and the neighborhoods built again: g->map gives the original label of each node.
+- rcm: reverse Cuthill-McKee, breadth-first search from the nodes of smallest degree,
+       visiting the neighbors by increasing degree, reversed
+- gorder: greedy Gorder, the next node is the one sharing the most neighbors (or edges)
+          with the last GORDERW nodes, common neighbors of degree larger than sqrt(n) are ignored
+- hub: hub clustering, nodes of degree larger than the average degree first, original order otherwise
+- bfs: breadth-first search from the nodes in original order
+*/
+
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "graph.h"
+
+
+#define ORD_NONE 0
+#define ORD_RCM 1
+#define ORD_GORDER 2
+#define ORD_HUB 3
+#define ORD_BFS 4
+#define GORDERW 5 //window of gorder
+
+char *ordnames[]={"none","rcm","gorder","hub","bfs"};
+#define NORDERS (sizeof(ordnames)/sizeof(char*))
+
+//index of the ordering called name, -1 if none
+int findorder(char *name){
+	unsigned i;
+	for (i=0;i<NORDERS;i++) {
+		if (strcmp(ordnames[i],name)==0)
+			return i;
+	}
+	return -1;
+}
+
+//breadth-first search order (order[i] is the i-th node), or reverse Cuthill-McKee order if rcm
+void bfsorder(graph *g,unsigned *order,int rcm){
+	unsigned i,h,l,s,u,v,k=0,max=0;
+	size_t j;
+	char *seen=calloc(g->n,sizeof(char));
+	nodedeg *start=NULL,*nd=NULL;
+
+	if (rcm){
+		start=malloc(g->n*sizeof(nodedeg));
+		for (i=0;i<g->n;i++) {
+			start[i].node=i;
+			start[i].deg=g->d0[i];
+			max=(g->d0[i]>max)?g->d0[i]:max;
+		}
+		qsort(start,g->n,sizeof(nodedeg),compare_nodedeg);
+		nd=malloc(max*sizeof(nodedeg));
+	}
+	for (i=0;i<g->n;i++) {
+		s=rcm?start[i].node:i;
+		if (seen[s])
+			continue;
+		seen[s]=1;
+		order[k++]=s;
+		for (h=k-1;h<k;h++) {//order[h..k[ is the queue
+			u=order[h];
+			l=0;
+			for (j=listoff(g,u);j<listoff(g,u+1);j++) {
+				v=g->adj[j];
+				if (seen[v])
+					continue;
+				seen[v]=1;
+				if (rcm){
+					nd[l].node=v;
+					nd[l++].deg=g->d0[v];
+				}
+				else {
+					order[k++]=v;
+				}
+			}
+			if (rcm){
+				qsort(nd,l,sizeof(nodedeg),compare_nodedeg);
+				for (j=0;j<l;j++)
+					order[k++]=nd[j].node;
+			}
+		}
+	}
+	if (rcm){
+		for (i=0;2*i+1<g->n;i++) {
+			u=order[i];
+			order[i]=order[g->n-1-i];
+			order[g->n-1-i]=u;
+		}
+	}
+	free(seen);
+	free(start);
+	free(nd);
+}
+
+//nodes of degree larger than the average degree first
+void huborder(graph *g,unsigned *order){
+	unsigned i,k=0;
+	double avg=2.*g->e/g->n;
+	for (i=0;i<g->n;i++) {
+		if (g->d0[i]>avg)
+			order[k++]=i;
+	}
+	for (i=0;i<g->n;i++) {
+		if (g->d0[i]<=avg)
+			order[k++]=i;
+	}
+}
+
+//unplaced nodes in lists by score: head[s] is the first node of score s, next/prev link the nodes
+typedef struct {
+	unsigned *score;
+	unsigned *head;
+	unsigned *next;
+	unsigned *prev;
+	unsigned top;//no node has a score larger than top
+	char *placed;
+} scorelists;
+
+static inline void unlinknode(scorelists *q,unsigned u){
+	if (q->prev[u]!=NONE)
+		q->next[q->prev[u]]=q->next[u];
+	else
+		q->head[q->score[u]]=q->next[u];
+	if (q->next[u]!=NONE)
+		q->prev[q->next[u]]=q->prev[u];
+}
+
+static inline void linknode(scorelists *q,unsigned u){
+	q->prev[u]=NONE;
+	q->next[u]=q->head[q->score[u]];
+	if (q->next[u]!=NONE)
+		q->prev[q->next[u]]=u;
+	q->head[q->score[u]]=u;
+}
+
+static inline void addscore(scorelists *q,unsigned u,int delta){
+	if (q->placed[u])
+		return;
+	unlinknode(q,u);
+	q->score[u]+=delta;
+	linknode(q,u);
+	if (q->score[u]>q->top)
+		q->top=q->score[u];
+}
+
+//node u enters (delta=1) or leaves (delta=-1) the window: score of its neighbors and 2-hop neighbors
+void windowscore(graph *g,scorelists *q,unsigned u,int delta,unsigned hub){
+	unsigned v,w;
+	size_t i,j;
+	for (i=listoff(g,u);i<listoff(g,u+1);i++) {
+		v=g->adj[i];
+		addscore(q,v,delta);
+		if (g->d0[v]>hub)
+			continue;
+		for (j=listoff(g,v);j<listoff(g,v+1);j++) {
+			w=g->adj[j];
+			if (w!=u)
+				addscore(q,w,delta);
+		}
+	}
+}
+
+//greedy Gorder: O(sum of d(v)^2) without the hubs, sequential
+void gorder(graph *g,unsigned *order){
+	unsigned i,u,max=0,hub=sqrt(g->n);
+	scorelists q;
+
+	for (i=0;i<g->n;i++) {
+		max=(g->d0[i]>g->d0[max])?i:max;
+	}
+	//a score is at most GORDERW*(d(u)+1)
+	q.score=calloc(g->n,sizeof(unsigned));
+	q.head=malloc(((size_t)GORDERW*(g->d0[max]+1)+1)*sizeof(unsigned));
+	memset(q.head,0xff,((size_t)GORDERW*(g->d0[max]+1)+1)*sizeof(unsigned));
+	q.next=malloc(g->n*sizeof(unsigned));
+	q.prev=malloc(g->n*sizeof(unsigned));
+	q.placed=calloc(g->n,sizeof(char));
+	q.top=0;
+	for (i=g->n;i>0;i--) {//nodes with the same score come out in original order
+		linknode(&q,i-1);
+	}
+
+	u=max;//start from the node of largest degree
+	for (i=0;i<g->n;i++) {
+		if (i>0){
+			while (q.head[q.top]==NONE)
+				q.top--;
+			u=q.head[q.top];
+		}
+		unlinknode(&q,u);
+		q.placed[u]=1;
+		order[i]=u;
+		windowscore(g,&q,u,1,hub);
+		if (i>=GORDERW){
+			windowscore(g,&q,order[i-GORDERW],-1,hub);
+		}
+	}
+	free(q.score);
+	free(q.head);
+	free(q.next);
+	free(q.prev);
+	free(q.placed);
+}
+
+//g->rank for the ordering ord from the neighborhoods with the original labels, which are freed
+void locord(graph *g,unsigned ord){
+	unsigned i,*order=malloc(g->n*sizeof(unsigned));
+	switch (ord) {
+		case ORD_RCM:
+			bfsorder(g,order,1);
+			break;
+		case ORD_GORDER:
+			gorder(g,order);
+			break;
+		case ORD_HUB:
+			huborder(g,order);
+			break;
+		case ORD_BFS:
+			bfsorder(g,order,0);
+			break;
+	}
+	g->rank=malloc(g->n*sizeof(unsigned));
+	for (i=0;i<g->n;i++) {
+		g->rank[order[i]]=i;
+	}
+	free(order);
+	free(g->cd);
+	free(g->cdl);
+	free(g->adj);
+	free(g->d0);
+	g->cd=NULL;
+	g->cdl=NULL;
+	g->adj=NULL;
+	g->d0=NULL;
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+Output of the pairs and their similarities.
+
+Each thread writes in its own buffer and flushes it in its own file prefix.k (k is the thread number),
+so that no lock is needed. A record is either binary: u (4 bytes), w (4 bytes) and nval floats (4 bytes each),
+or text: "u w val1 ... valnval\n" with 6 decimals.
+*/
+
+#ifndef PAIROUT_H
+#define PAIROUT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+#define PAIRBUF 4194304 //size of the buffer of each thread in bytes
+
+typedef struct {
+	int fd;
+	int text;//1 for text, 0 for binary records
+	unsigned nval;//number of similarities per pair
+	size_t len;//number of bytes in the buffer
+	char *buf;
+} pairfile;
+
+//append: add the pairs at the end of the file instead of replacing it
+pairfile* openpairs(char* prefix,unsigned k,int text,unsigned nval,int append){
+	pairfile *f=malloc(sizeof(pairfile));
+	char *path=malloc(strlen(prefix)+16);
+
+	sprintf(path,"%s.%u",prefix,k);
+	f->fd=open(path,O_WRONLY|O_CREAT|(append?O_APPEND:O_TRUNC),0644);
+	if (f->fd<0){
+		fprintf(stderr,"Cannot write pairs in file %s\n",path);
+		exit(1);
+	}
+	free(path);
+	f->text=text;
+	f->nval=nval;
+	f->len=0;
+	f->buf=malloc(PAIRBUF);
+	return f;
+}
+
+void flushpairs(pairfile *f){
+	size_t i=0;
+	ssize_t r;
+	while (i<f->len) {
+		r=write(f->fd,f->buf+i,f->len-i);
+		if (r<0){
+			perror("write pairs");
+			exit(1);
+		}
+		i+=r;
+	}
+	f->len=0;
+}
+
+//write x in decimal, returns the number of characters
+static inline unsigned writeuint(char *s,unsigned long long x){
+	char tmp[20];
+	unsigned i=0,l;
+	do {
+		tmp[i++]='0'+x%10;
+		x/=10;
+	} while (x);
+	for (l=0;l<i;l++)
+		s[l]=tmp[i-1-l];
+	return i;
+}
+
+//write a nonnegative value with 6 decimals, returns the number of characters
+static inline unsigned writefixed(char *s,double val){
+	unsigned long long x=(unsigned long long)(val*1e6+0.5);
+	unsigned i,l=writeuint(s,x/1000000);
+	x%=1000000;
+	s[l++]='.';
+	for (i=6;i>0;i--) {
+		s[l+i-1]='0'+x%10;
+		x/=10;
+	}
+	return l+6;
+}
+
+//val has f->nval entries
+static inline void writepair(pairfile *f,unsigned u,unsigned w,double *val){
+	unsigned i;
+	float x;
+	if (f->len+32*(f->nval+2)>PAIRBUF)
+		flushpairs(f);
+	if (f->text){
+		f->len+=writeuint(f->buf+f->len,u);
+		f->buf[f->len++]=' ';
+		f->len+=writeuint(f->buf+f->len,w);
+		for (i=0;i<f->nval;i++) {
+			f->buf[f->len++]=' ';
+			f->len+=writefixed(f->buf+f->len,val[i]);
+		}
+		f->buf[f->len++]='\n';
+	}
+	else {
+		memcpy(f->buf+f->len,&u,4);
+		memcpy(f->buf+f->len+4,&w,4);
+		f->len+=8;
+		for (i=0;i<f->nval;i++) {
+			x=val[i];
+			memcpy(f->buf+f->len,&x,4);
+			f->len+=4;
+		}
+	}
+}
+
+void closepairs(pairfile *f){
+	flushpairs(f);
+	close(f->fd);
+	free(f->buf);
+	free(f);
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+Instrumentation of a run: monotonic phase timers, per-thread work counters, peak RSS,
+and a JSON report of all of them with the histogram (neighsim -j report.json).
+*/
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/resource.h>
+
+
+#define PH_READ 0 //reading the edge list, or mapping the binary graph
+#define PH_ORDER 1 //degree ordering or locality ordering
+#define PH_BUILD 2 //neighborhoods
+#define PH_SCHED 3 //costs and tasks
+#define PH_COMPUTE 4 //kernel
+#define NPHASES 5
+char *phnames[NPHASES]={"read","order","build","schedule","compute"};
+
+//counters of one thread in the kernel, written once at the end
+typedef struct {
+	unsigned long long wedges;//paths u-v-w visited
+	unsigned long long cands;//nodes w with a common neighbor, i.e. similarities evaluated
+	unsigned long long pairs;//pairs written
+	double busy;//seconds spent on the tasks
+	size_t scratch;//bytes of the accumulators
+} threadstats;
+
+typedef struct {
+	char *input;
+	char *metric;
+	double a;
+	unsigned dmax;
+	unsigned n;
+	size_t e;
+	double last;//end of the last phase
+	double t[NPHASES];//seconds spent in each phase
+	unsigned nthreads;
+	threadstats *th;
+} runstats;
+
+//monotonic clock in seconds
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+void initstats(runstats *st,unsigned nthreads){
+	bzero(st,sizeof(runstats));
+	st->nthreads=nthreads;
+	st->th=calloc(nthreads,sizeof(threadstats));
+	st->last=now();
+}
+
+//the phase ph ends now
+void endphase(runstats *st,unsigned ph){
+	double t=now();
+	st->t[ph]+=t-st->last;
+	st->last=t;
+}
+
+//peak resident set size in kB: of this process, or of the largest of its children reaped (the workers of -P)
+long peakrss(){
+	struct rusage ru,rc;
+	getrusage(RUSAGE_SELF,&ru);
+	getrusage(RUSAGE_CHILDREN,&rc);
+	return (rc.ru_maxrss>ru.ru_maxrss)?rc.ru_maxrss:ru.ru_maxrss;
+}
+
+//s as a JSON string: quotes, backslashes and control characters escaped
+void writestring(FILE *file,char *s){
+	fputc('"',file);
+	for (;*s!=0;s++){
+		if (*s=='"' || *s=='\\')
+			fprintf(file,"\\%c",*s);
+		else if ((unsigned char)*s<0x20)
+			fprintf(file,"\\u%04x",(unsigned char)*s);
+		else
+			fputc(*s,file);
+	}
+	fputc('"',file);
+}
+
+void writereport(char *path,runstats *st,unsigned long long *hist,unsigned nval){
+	unsigned i,k;
+	double tot=0,busy=0,maxbusy=0;
+	unsigned long long wedges=0,cands=0,pairs=0;
+	threadstats *th;
+	FILE *file=fopen(path,"w");
+
+	if (file==NULL){
+		fprintf(stderr,"Cannot write report %s\n",path);
+		return;
+	}
+	for (i=0;i<NPHASES;i++)
+		tot+=st->t[i];
+	for (i=0;i<st->nthreads;i++){
+		wedges+=st->th[i].wedges;
+		cands+=st->th[i].cands;
+		pairs+=st->th[i].pairs;
+		busy+=st->th[i].busy;
+		maxbusy=(st->th[i].busy>maxbusy)?st->th[i].busy:maxbusy;
+	}
+	fprintf(file,"{\n");
+	fprintf(file,"  \"input\": ");
+	writestring(file,st->input);
+	fprintf(file,",\n  \"metric\": ");
+	writestring(file,st->metric);
+	fprintf(file,",\n");
+	fprintf(file,"  \"a\": %g,\n",st->a);
+	if (st->dmax!=UINT_MAX)
+		fprintf(file,"  \"dmax\": %u,\n",st->dmax);
+	else
+		fprintf(file,"  \"dmax\": null,\n");
+	fprintf(file,"  \"nodes\": %u,\n",st->n);
+	fprintf(file,"  \"edges\": %zu,\n",st->e);
+	fprintf(file,"  \"threads\": %u,\n",st->nthreads);
+	fprintf(file,"  \"time\": {");
+	for (i=0;i<NPHASES;i++)
+		fprintf(file,"\"%s\": %.6f, ",phnames[i],st->t[i]);
+	fprintf(file,"\"total\": %.6f},\n",tot);
+	fprintf(file,"  \"wedges\": %llu,\n",wedges);
+	fprintf(file,"  \"candidates\": %llu,\n",cands);
+	fprintf(file,"  \"pairs\": %llu,\n",pairs);
+	fprintf(file,"  \"wedges_per_s\": %.1f,\n",(st->t[PH_COMPUTE]>0)?wedges/st->t[PH_COMPUTE]:0.);
+	//slowest thread over average thread: 1 is a perfect balance
+	fprintf(file,"  \"imbalance\": %.4f,\n",(busy>0)?maxbusy*st->nthreads/busy:1.);
+	fprintf(file,"  \"peak_rss_kb\": %ld,\n",peakrss());
+	fprintf(file,"  \"per_thread\": [\n");
+	for (i=0;i<st->nthreads;i++){
+		th=st->th+i;
+		fprintf(file,"    {\"wedges\": %llu, \"candidates\": %llu, \"pairs\": %llu, \"busy\": %.6f, \"scratch_bytes\": %zu}%s\n",
+			th->wedges,th->cands,th->pairs,th->busy,th->scratch,(i+1<st->nthreads)?",":"");
+	}
+	fprintf(file,"  ],\n");
+	fprintf(file,"  \"histogram\": [");
+	for (k=0;k<nval;k++){
+		fprintf(file,"%s[",(k>0)?", ":"");
+		for (i=0;i<10;i++)
+			fprintf(file,"%s%llu",(i>0)?", ":"",hist[10*k+i]);
+		fprintf(file,"]");
+	}
+	fprintf(file,"]\n}\n");
+	fclose(file);
+}
+
+void freestats(runstats *st){
+	free(st->th);
+}
+
+#endif
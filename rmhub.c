@@ -1,52 +1,372 @@
 /*
-gcc rmhub.c -O9 -o rmhub
-./rmhub max-degree net_input net_output
+gcc rmhub.c -O9 -o rmhub -fopenmp
+./rmhub max-degree net.txt|net.bin out
+./rmhub [-d max-degree] [-p percent] [-c budget] [-k k] [-b] [-n n_threads] net.txt|net.bin out
+
+Removes the hubs of a graph, so that the similarities are computed in a given time: the running time of the
+kernels is about the number of wedges, sum of d(v)^2 over the nodes v. The degree threshold D is given by one of:
+- -d max-degree (or the first argument): D=max-degree
+- -p percent: the smallest D such that at most this percentage of the nodes (of degree at least 1) have a larger degree
+- -c budget: the largest D such that the nodes of degree at most D have a sum of d(v)^2 of at most budget
+  (an upper bound on the wedges left, the degrees only decreasing once the hubs are removed)
+Each node of degree larger than D loses all its edges. With -k, the graph left is then peeled to its k-core:
+the nodes of degree smaller than k are removed, in parallel rounds, until all the nodes left have at least k neighbors.
+The input is read in parallel as by the other tools (graph.h): the edge list, or the binary graph of any of them.
+The output is the edge list left, in text ("source target" on each line, the original IDs), or with -b the binary
+graph of sim.c (neighsim without -a), built once there and loaded directly by the next run.
 */
 
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
+#include "graph.h"
+
 
-#define NNODES 100000000 //Maximum number of node, will automatically increase if needed.
+#define WBLOCK 1048576 //edges formatted by a thread at once
 
-//compute the maximum of three unsigned
-unsigned max3(unsigned a,unsigned b,unsigned c){
-	a=(a>b) ? a : b;
-	return (a>c) ? a : c;
+void usage(char *prog){
+	fprintf(stderr,"%s max-degree net.txt|net.bin out\n",prog);
+	fprintf(stderr,"%s [options] net.txt|net.bin out\n",prog);
+	fprintf(stderr,"-d max-degree: remove the nodes of degree larger than max-degree\n");
+	fprintf(stderr,"-p percent: remove at most this percentage of the nodes, those of largest degree\n");
+	fprintf(stderr,"-c budget: remove the nodes of largest degree until the others have a sum of d^2 of at most budget (e.g. 1e10)\n");
+	fprintf(stderr,"-k k: then peel the graph left to its k-core\n");
+	fprintf(stderr,"-b: write the binary graph of sim (neighsim without -a) instead of text\n");
+	fprintf(stderr,"-n n_threads: threads to use (default: all)\n");
+	exit(1);
 }
 
-int main(int argc,char** argv){
-	unsigned s,t,n=0,n_max=NNODES,maxd=atoi(argv[1]);
-	unsigned *d=malloc(n_max*sizeof(unsigned));
-	FILE *file1,*file2;
+//original ID of node u of a binary graph
+static inline unsigned origid(graph *g,unsigned u){
+	return (g->map!=NULL)?g->map[u]:u;
+}
+
+//u-w is taken from the list of u if the original IDs are s<t, a self-loop once out of its two entries
+static inline unsigned takeedge(unsigned s,unsigned t,unsigned *loops){
+	return s<t || (s==t && (*loops)++%2==0);
+}
+
+//edge list of a binary graph, with the original IDs
+graph* binedges(char *path){
+	binheader h;
+	graph *b,*g=calloc(1,sizeof(graph));
+	unsigned u,*cnt;
+	size_t *off;
+
+	b=loadbin(path,&h);
+	if (h.flags&(BIN_OUT|BIN_IN)){
+		fprintf(stderr,"%s is a directed graph\n",path);
+		exit(1);
+	}
+	g->n=b->n;
+	cnt=calloc(b->n,sizeof(unsigned));
+	off=malloc((b->n+1)*sizeof(size_t));
+	#pragma omp parallel
+	{
+	unsigned *buf=NULL,size=0,*l,i,loops;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<b->n;u++){
+		l=neighbors(b,u,&buf,&size);
+		for (i=0,loops=0;i<listlen(b,u);i++)
+			cnt[u]+=takeedge(origid(b,u),origid(b,l[i]),&loops);
+	}
+	free(buf);
+	}
+	prefixsum(cnt,NULL,off,b->n);
+	g->e=off[b->n];
+	g->edges=malloc(g->e*sizeof(edge));
+	#pragma omp parallel
+	{
+	unsigned *buf=NULL,size=0,*l,i,loops;
+	size_t k;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<b->n;u++){
+		l=neighbors(b,u,&buf,&size);
+		for (i=0,k=off[u],loops=0;i<listlen(b,u);i++){
+			if (takeedge(origid(b,u),origid(b,l[i]),&loops)){
+				g->edges[k].s=origid(b,u);
+				g->edges[k++].t=origid(b,l[i]);
+			}
+		}
+	}
+	free(buf);
+	}
+	free(cnt);
+	free(off);
+	freegraph(b);
+	return g;
+}
+
+//degree of each node in the edge list, the largest one in *dmax
+unsigned* degrees(graph *g,unsigned *dmax){
+	unsigned *d=calloc(g->n,sizeof(unsigned)),i,max=0;
+	size_t k;
+	#pragma omp parallel for
+	for (k=0;k<g->e;k++){
+		#pragma omp atomic
+		d[g->edges[k].s]++;
+		#pragma omp atomic
+		d[g->edges[k].t]++;
+	}
+	#pragma omp parallel for reduction(max:max)
+	for (i=0;i<g->n;i++)
+		max=(d[i]>max)?d[i]:max;
+	*dmax=max;
+	return d;
+}
+
+//degree threshold of a policy from the number of nodes of each degree nd[0..dmax]
+unsigned threshold(unsigned long long *nd,unsigned dmax,double percent,double budget){
+	unsigned long long nodes=0,above=0;
+	double cost=0;
+	unsigned x;
+	if (percent>=0){
+		for (x=1;x<=dmax;x++)
+			nodes+=nd[x];
+		//the nodes of degree larger than x-1 are too many
+		for (x=dmax;x>0 && above+nd[x]<=percent/100.*nodes;x--)
+			above+=nd[x];
+		return x;
+	}
+	for (x=1;x<=dmax && cost+(double)nd[x]*x*x<=budget;x++)
+		cost+=(double)nd[x]*x*x;
+	return x-1;
+}
 
-	printf("Maximum in-degree allowed = %u\n",maxd);
+//keep the edges whose two endpoints are kept, in the same order
+void keepedges(graph *g,char *keep){
+	unsigned p=omp_get_max_threads();
+	size_t *e_p=calloc(p+1,sizeof(size_t)),j;
+	edge *out=malloc(g->e*sizeof(edge));
 
-	printf("Reading edgelist from file %s\n",argv[3]);
-	file1=fopen(argv[3],"r");
-	while (fscanf(file1,"%u %u\n", &s, &t)==2) {
-		n=max3(n,s+1,t+1);
-		if (n>n_max) {
-			d=realloc(d,(n+NNODES)*sizeof(unsigned));
-			bzero(d+n_max,(n+NNODES-n_max)*sizeof(unsigned));
-			n_max=n+NNODES;
+	#pragma omp parallel num_threads(p) private(j)
+	{
+		unsigned k=omp_get_thread_num();
+		size_t lo=g->e*k/p,hi=g->e*(k+1)/p,m=0;
+		for (j=lo;j<hi;j++)
+			m+=(keep[g->edges[j].s] && keep[g->edges[j].t]);
+		e_p[k+1]=m;
+		#pragma omp barrier
+		#pragma omp single
+		for (j=0;j<p;j++)
+			e_p[j+1]+=e_p[j];
+		m=e_p[k];
+		for (j=lo;j<hi;j++){
+			if (keep[g->edges[j].s] && keep[g->edges[j].t])
+				out[m++]=g->edges[j];
 		}
-		d[t]++;
-		d[s]++;
 	}
-	fclose(file1);
+	free(g->edges);
+	g->edges=out;
+	g->e=e_p[p];
+	free(e_p);
+}
+
+//peel the graph to its k-core: keep[u] is cleared for the nodes removed, returns their number
+//a node is removed in the round where its degree falls below k: the thread decrementing it from k takes it
+unsigned peel(graph *g,char *keep,unsigned k){
+	unsigned *d=mkcsr(g,0),*front=malloc(g->n*sizeof(unsigned)),*next=malloc(g->n*sizeof(unsigned)),*tmp,nf=0,nn,i,u,removed=0;
+	size_t j;
 
-	printf("Writting edgelist in file %s\n",argv[3]);
-	file1=fopen(argv[2],"r");
-	file2=fopen(argv[3],"w");
-	while (fscanf(file1,"%u %u\n", &s, &t)==2) {
-		if (d[s]<maxd && d[t]<maxd){
-			fprintf(file2,"%u %u\n", s, t);
+	for (u=0;u<g->n;u++){
+		if (d[u]>0 && d[u]<k){
+			keep[u]=0;
+			front[nf++]=u;
+		}
+	}
+	while (nf>0) {
+		removed+=nf;
+		nn=0;
+		#pragma omp parallel for schedule(dynamic, 64) private(j)
+		for (i=0;i<nf;i++){
+			unsigned w,x,y;
+			for (j=listoff(g,front[i]);j<listoff(g,front[i]+1);j++){
+				w=g->adj[j];
+				#pragma omp atomic capture
+				x=d[w]--;
+				if (x==k){
+					keep[w]=0;
+					#pragma omp atomic capture
+					y=nn++;
+					next[y]=w;
+				}
+			}
 		}
+		tmp=front;
+		front=next;
+		next=tmp;
+		nf=nn;
 	}
-	fclose(file1);
-	fclose(file2);
+	free(d);
+	free(front);
+	free(next);
+	free(g->cd);
+	free(g->cdl);
+	free(g->adj);
+	g->cd=NULL;
+	g->cdl=NULL;
+	g->adj=NULL;
+	return removed;
+}
 
-	return 0;
+static inline char* putuint(char *p,unsigned x){
+	char tmp[10];
+	int l=0;
+	do {
+		tmp[l++]='0'+x%10;
+		x/=10;
+	} while (x>0);
+	while (l>0)
+		*p++=tmp[--l];
+	return p;
+}
+
+//write the edges in text: blocks of WBLOCK edges formatted in parallel, written in order
+void writetext(graph *g,char *path){
+	unsigned p=omp_get_max_threads(),k;
+	char **buf=malloc(p*sizeof(char*));
+	size_t *len=calloc(p,sizeof(size_t)),r;
+	FILE *file=fopen(path,"w");
+
+	if (file==NULL){
+		fprintf(stderr,"Cannot write %s\n",path);
+		exit(1);
+	}
+	for (k=0;k<p;k++)
+		buf[k]=malloc(WBLOCK*22);
+	for (r=0;r<g->e;r+=(size_t)p*WBLOCK){
+		#pragma omp parallel for num_threads(p) schedule(static, 1)
+		for (k=0;k<p;k++){
+			size_t lo=r+(size_t)k*WBLOCK,hi=lo+WBLOCK,j;
+			char *q=buf[k];
+			hi=(hi<g->e)?hi:g->e;
+			for (j=lo;j<hi;j++){
+				q=putuint(q,g->edges[j].s);
+				*q++=' ';
+				q=putuint(q,g->edges[j].t);
+				*q++='\n';
+			}
+			len[k]=(lo<hi)?q-buf[k]:0;
+		}
+		for (k=0;k<p;k++){
+			if (fwrite(buf[k],1,len[k],file)!=len[k]){
+				fprintf(stderr,"Cannot write %s\n",path);
+				exit(1);
+			}
+		}
+	}
+	fclose(file);
+	for (k=0;k<p;k++)
+		free(buf[k]);
+	free(buf);
+	free(len);
 }
 
+int main(int argc,char** argv){
+	graph *g;
+	unsigned *d,dmax,x,maxd=UINT_MAX,k=0,u,removed=0;
+	unsigned long long *nd;
+	double percent=-1,budget=-1,before=0,after=0;
+	size_t e0;
+	char *keep;
+	int c,bin=0,pol=0;
+
+	while ((c=getopt(argc,argv,"d:p:c:k:bn:"))!=-1) {
+		switch (c) {
+			case 'd':
+				maxd=atoi(optarg);
+				pol++;
+				break;
+			case 'p':
+				percent=atof(optarg);
+				pol++;
+				break;
+			case 'c':
+				budget=atof(optarg);
+				pol++;
+				break;
+			case 'k':
+				k=atoi(optarg);
+				break;
+			case 'b':
+				bin=1;
+				break;
+			case 'n':
+				omp_set_num_threads(atoi(optarg));
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc-optind==3 && pol==0){
+		maxd=atoi(argv[optind++]);
+		pol++;
+	}
+	if (argc-optind!=2 || pol>1 || (pol==0 && k==0) || (percent>=0 && percent>100))
+		usage(argv[0]);
+
+	if (isbin(argv[optind])){
+		printf("Loading binary graph from file %s\n",argv[optind]);
+		g=binedges(argv[optind]);
+	}
+	else {
+		printf("Reading edgelist from file %s\n",argv[optind]);
+		g=readedgelist(argv[optind]);
+	}
+	e0=g->e;
+	printf("Number of nodes: %u\n",g->n);
+	printf("Number of edges: %zu\n",g->e);
+
+	d=degrees(g,&dmax);
+	nd=calloc(dmax+1,sizeof(unsigned long long));
+	#pragma omp parallel for
+	for (u=0;u<g->n;u++){
+		#pragma omp atomic
+		nd[d[u]]++;
+	}
+	for (x=1;x<=dmax;x++)
+		before+=(double)nd[x]*x*x;
+	if (percent>=0 || budget>=0)
+		maxd=threshold(nd,dmax,percent,budget);
+	free(nd);
+	printf("Maximum degree: %u, sum of d^2: %.0f\n",dmax,before);
+
+	keep=malloc(g->n*sizeof(char));
+	if (pol>0){
+		printf("Maximum degree allowed = %u\n",maxd);
+		#pragma omp parallel for reduction(+:removed)
+		for (u=0;u<g->n;u++){
+			keep[u]=(d[u]<=maxd);
+			removed+=!keep[u];
+		}
+		printf("Hubs removed: %u\n",removed);
+	}
+	else {
+		memset(keep,1,g->n*sizeof(char));
+	}
+	free(d);
+	keepedges(g,keep);
+	if (k>0){
+		removed=peel(g,keep,k);
+		printf("Nodes removed by the %u-core: %u\n",k,removed);
+		keepedges(g,keep);
+	}
+
+	d=degrees(g,&dmax);
+	#pragma omp parallel for reduction(+:after)
+	for (u=0;u<g->n;u++)
+		after+=(double)d[u]*d[u];
+	free(d);
+	printf("Edges left: %zu of %zu, maximum degree: %u, sum of d^2: %.0f\n",g->e,e0,dmax,after);
+
+	if (bin){
+		printf("Writing binary graph in file %s\n",argv[optind+1]);
+		g->d=mkcsr(g,1);
+		savebin(g,argv[optind+1],BIN_DESC,NODMAX);
+	}
+	else {
+		printf("Writing edgelist in file %s\n",argv[optind+1]);
+		writetext(g,argv[optind+1]);
+	}
+	free(keep);
+	freegraph(g);
+
+	return 0;
+}
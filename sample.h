@@ -0,0 +1,350 @@
+/*
+Estimated histogram (neighsim -e err / -T seconds): the histogram of all the pairs with a common neighbor,
+from the exact similarities of a random sample of sources instead of all of them, with confidence intervals.
+
+The cost of a source u is its number of wedges u-v-w: the sum of d(v)-1 over its neighbors v (of degree
+smaller or equal to dmax), about its number of 2-hop neighbors and the time to count them. The sources are drawn
+with replacement with a probability p(u) proportional to the square root of their cost (importance sampling),
+and each one counts its 2-hop neighbors in the accumulator of the thread (see server.h): g(u) pairs in each bucket.
+The variance reached in a given time is the smallest for p(u) proportional to g(u)/sqrt(cost), g(u) being about
+proportional to the cost: drawing proportionally to the cost (a wedge drawn uniformly gives its source) would
+spend most of the time on the largest sources, drawn again and again.
+Each pair being counted by its two nodes, g(u)/(2p(u)) is an unbiased estimate of each bucket (Hansen-Hurwitz),
+and the mean over s sources is within SAMPLEZ standard errors of the true value with a probability of 95%.
+The i-th source drawn is given by a hash of i, in rounds of max(SAMPLEROUND, s/SAMPLEGROW) sources after s of
+them: with -e alone, the same samples for any number of threads. After each round, the run stops when the time
+budget is spent, or when the half-width of the interval of each bucket is at most err times its estimate, the
+buckets with less than SAMPLEMIN of the pairs (whose relative error converges much more slowly) being printed with
+their interval but not waited for.
+Drawn with replacement, the samples can cost more than all the sources: the exact histogram is computed instead
+(see kernel.h) once their wedges reach those of all the sources, or a quarter of them if the error, decreasing as
+1/sqrt(s), would need the rest.
+*/
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "engine.h"
+#include "server.h"
+
+
+#define SAMPLESEED 0x9fb21c651e98df25ULL //seed of the sources drawn
+#define SAMPLEZ 1.96 //standard errors of a 95% confidence interval
+#define SAMPLEMIN 0.001 //share of the pairs below which the error of a bucket is not waited for
+#define SAMPLEFIRST 100 //sources drawn before the error is checked
+#define SAMPLEROUND 64 //sources drawn between two checks, at least
+#define SAMPLEGROW 16 //and a round of s/SAMPLEGROW after s sources
+#define SAMPLEEXACT 4 //share 1/SAMPLEEXACT of the wedges from which the error is extrapolated
+
+//sources drawn with a probability proportional to the square root of their cost
+typedef struct {
+	unsigned long long *cost;//wedges of each source
+	double *cum;//cum[u]: sum of the weights sqrt(cost) of the sources before u, cum[n] the total
+	unsigned long long wedges;//sum of the costs
+	unsigned n;
+} sampler;
+
+sampler* mksampler(graph *g,unsigned dmax){
+	sampler *sp=malloc(sizeof(sampler));
+	unsigned u;
+	sp->n=g->n;
+	sp->cost=malloc(g->n*sizeof(unsigned long long));
+	sp->cum=malloc((g->n+1)*sizeof(double));
+
+	#pragma omp parallel
+	{
+	unsigned *buf=NULL,size=0,*nu,i;
+	unsigned long long c;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=0;u<g->n;u++){
+		if (u>=nsources(g)){
+			sp->cost[u]=0;//other side of a directed graph, never drawn
+			continue;
+		}
+		nu=neighbors(g,u,&buf,&size);
+		for (i=0,c=0;i<listlen(g,u);i++){
+			if (g->d0[nu[i]]<=dmax)
+				c+=listlen(g,nu[i])-1;
+		}
+		sp->cost[u]=c;
+	}
+	free(buf);
+	}
+	sp->cum[0]=0;
+	sp->wedges=0;
+	for (u=0;u<g->n;u++){
+		sp->wedges+=sp->cost[u];
+		sp->cum[u+1]=sp->cum[u]+sqrt((double)sp->cost[u]);
+	}
+	return sp;
+}
+
+void freesampler(sampler *sp){
+	free(sp->cost);
+	free(sp->cum);
+	free(sp);
+}
+
+//the i-th source drawn: the first u with cum[u+1]>r, for r uniform in [0,cum[n][
+unsigned draw(sampler *sp,unsigned long long i){
+	double r=(mix64(SAMPLESEED+i)>>11)*0x1p-53*sp->cum[sp->n];
+	unsigned lo=0,hi=sp->n-1,mid;
+	while (lo<hi) {
+		mid=lo+(hi-lo)/2;
+		if (sp->cum[mid+1]>r)
+			hi=mid;
+		else
+			lo=mid+1;
+	}
+	return lo;
+}
+
+//estimate and half-width of the confidence interval of each entry from the sums of s samples and of their squares
+void interval(double *sum,double *sq,unsigned m,unsigned long long s,double *est,double *hw){
+	unsigned i;
+	double var;
+	for (i=0;i<m;i++){
+		est[i]=(s>0)?sum[i]/s:0.;
+		var=(s>1)?(sq[i]-sum[i]*est[i])/(s-1):0.;
+		hw[i]=(s>1)?SAMPLEZ*sqrt((var>0)?var/s:0.):INFINITY;
+	}
+}
+
+//largest relative half-width of the buckets with at least SAMPLEMIN of the pairs of their similarity
+double relerror(double *est,double *hw,unsigned nval){
+	unsigned i,k;
+	double tot,e=0;
+	for (k=0;k<nval;k++){
+		for (i=0,tot=0;i<10;i++)
+			tot+=est[10*k+i];
+		for (i=0;i<10;i++){
+			if (est[10*k+i]>0 && est[10*k+i]>=SAMPLEMIN*tot && hw[10*k+i]/est[10*k+i]>e)
+				e=hw[10*k+i]/est[10*k+i];
+		}
+	}
+	return e;
+}
+
+//histogram estimated from sampled sources until prm->eps or prm->tmax is reached, the last entry being the total
+//of the first similarity, estimates in est and half-widths in hw, returns the number of sources drawn
+//*exact: stopped because the samples cost about as much as the exact histogram
+unsigned long long samplehist(graph *g,sampler *sp,params *prm,double *est,double *hw,bool *exact,threadstats *th){
+	metricinfo *mi=metrics+prm->metric;
+	server *sv=mkserver(g,prm->dmax,prm->hashmax);
+	unsigned m=10*mi->nval+1;
+	unsigned long long s=0,next=SAMPLEFIRST,wedges=0,round=SAMPLEROUND;
+	double *sum=calloc(m,sizeof(double)),*sq=calloc(m,sizeof(double)),t0=now(),err;
+	bool done=(sp->cum[g->n]==0);
+
+	*exact=0;
+	if (done){
+		bzero(est,m*sizeof(double));
+		bzero(hw,m*sizeof(double));
+	}
+
+	#pragma omp parallel
+	{
+	worker wk;
+	unsigned long long i,drawn=0,w_p=0,cands=0;
+	unsigned j,k,n,u,w,p=omp_get_thread_num();
+	double *sum_p=calloc(m,sizeof(double)),*sq_p=calloc(m,sizeof(double)),*x=malloc(m*sizeof(double));
+	double val[MAXVAL],c,f,t1;
+	bool hashed;
+	initworker(&wk);
+	while (!done) {
+		#pragma omp for schedule(dynamic, 1)
+		for (i=s;i<s+round;i++){
+			if (prm->tmax>0 && now()-t0>=prm->tmax)
+				continue;
+			t1=now();
+			u=draw(sp,i);
+			bzero(x,m*sizeof(double));
+			n=accumulate(sv,&wk,mi,u,&hashed);
+			for (j=0;j<n;j++){
+				w=takecounter(&wk.acc,j,hashed,&c);
+				mi->eval(val,c,g->d[u],g->d[w]);
+				for (k=0;k<mi->nval;k++)
+					x[10*k+bucket(val[k])]++;
+			}
+			x[m-1]=n;
+			//g(u)/(2p(u))
+			f=sp->cum[g->n]/(2.*sqrt((double)sp->cost[u]));
+			for (j=0;j<m;j++){
+				sum_p[j]+=x[j]*f;
+				sq_p[j]+=x[j]*f*x[j]*f;
+			}
+			drawn++;
+			w_p+=sp->cost[u];
+			cands+=n;
+			th[p].busy+=now()-t1;
+		}
+		#pragma omp critical
+		{
+			for (j=0;j<m;j++){
+				sum[j]+=sum_p[j];
+				sq[j]+=sq_p[j];
+			}
+			s+=drawn;
+			wedges+=w_p;
+		}
+		bzero(sum_p,m*sizeof(double));
+		bzero(sq_p,m*sizeof(double));
+		th[p].wedges+=w_p;
+		th[p].cands+=cands;
+		drawn=w_p=cands=0;
+		#pragma omp barrier
+		#pragma omp single
+		{
+			interval(sum,sq,m,s,est,hw);
+			err=relerror(est,hw,mi->nval);
+			if (s>=next){
+				printf("Sampled sources: %llu, wedges: %.2f%% of all, largest relative error: %.4f\n",s,100.*wedges/sp->wedges,err);
+				fflush(stdout);
+				next*=2;
+			}
+			if ((prm->tmax>0 && now()-t0>=prm->tmax) || (prm->eps>0 && s>=SAMPLEFIRST && err<=prm->eps))
+				done=1;
+			else if (wedges>=sp->wedges || (prm->eps>0 && SAMPLEEXACT*wedges>=sp->wedges && wedges*(err/prm->eps)*(err/prm->eps)>=sp->wedges))
+				done=*exact=1;
+			round=(s/SAMPLEGROW>SAMPLEROUND)?s/SAMPLEGROW:SAMPLEROUND;
+		}
+	}
+	freeworker(&wk);
+	free(sum_p);
+	free(sq_p);
+	free(x);
+	}
+	printf("Sampled sources: %llu, wedges: %.2f%% of all, largest relative error: %.4f\n",s,(sp->wedges>0)?100.*wedges/sp->wedges:0.,relerror(est,hw,mi->nval));
+	free(sum);
+	free(sq);
+	freeserver(sv);
+	return s;
+}
+
+void printestimate(params *prm,double *est,double *hw,unsigned long long s){
+	metricinfo *m=metrics+prm->metric;
+	unsigned i,k;
+
+	printf("ESTIMATED FROM %llu SAMPLED SOURCES: 95%% CONFIDENCE INTERVALS\n",s);
+	printf("Number of %s similarities in\n",m->desc);
+	for (i=0;i<10;i++){
+		if (i==9 && !m->norm){
+			printf("]0.9, +inf[ = ");
+		}
+		else {
+			printf("]0.%u, %s%u] = ",i,(i<9)?"0.":"1.",(i+1)%10);
+		}
+		for (k=0;k<m->nval;k++){
+			printf((k+1<m->nval)?"%.0f +- %.0f, ":"%.0f +- %.0f\n",est[10*k+i],hw[10*k+i]);
+		}
+	}
+	if (m->nval>1){
+		printf("Number of non-zero similarities = %.0f +- %.0f\n",est[10*m->nval],hw[10*m->nval]);
+	}
+	else {
+		printf("Number of non-zero %s similarities = %.0f +- %.0f\n",m->desc,est[10],hw[10]);
+	}
+}
+
+//estimation run: read/build the graph without degree ordering, sample, print
+int samplerun(params *prm,char *input){
+	params lp=*prm;
+	metricinfo *mi=metrics+prm->metric;
+	graph *g;
+	sampler *sp;
+	schedule *sc;
+	runstats st;
+	unsigned long long s,*hist;
+	unsigned i,m=10*mi->nval+1;
+	double t0,t1,*est,*hw;
+	bool exact;
+	t1=now();
+	t0=t1;
+
+	if (prm->a>0 || prm->join || prm->topk>0 || prm->prefix!=NULL || prm->budget>0 || prm->nshards>1 || prm->batch!=NULL || prm->lsh>0){
+		fprintf(stderr,"Estimated histogram of all the pairs in memory, without -a, -x, -o, -k, -M, -P, -u or -l\n");
+		return 1;
+	}
+	if (prm->eps<0 || prm->tmax<0){
+		fprintf(stderr,"Estimated histogram with a positive error or time budget\n");
+		return 1;
+	}
+	initstats(&st,omp_get_max_threads());
+	st.input=input;
+	st.metric=mi->name;
+	st.dmax=prm->dmax;
+	if (prm->dmax!=NODMAX){
+		printf("Only taking into account common neighbors with degree <= %u\n",prm->dmax);
+	}
+
+	lp.a=0;
+	g=loadgraph(&lp,input,NULL,&t1,&st);
+	if (g==NULL){
+		freestats(&st);
+		return 1;
+	}
+	st.n=g->n;
+	st.e=g->e;
+	printtime(&t1);
+
+	sp=mksampler(g,prm->dmax);
+	printf("Number of wedges: %llu\n",sp->wedges);
+	endphase(&st,PH_SCHED);
+
+	printf("Estimating %s similarities (",mi->desc);
+	if (prm->eps>0)
+		printf("relative error %g%s",prm->eps,(prm->tmax>0)?", ":")\n");
+	if (prm->tmax>0)
+		printf("time budget %gs)\n",prm->tmax);
+	est=malloc(m*sizeof(double));
+	hw=malloc(m*sizeof(double));
+	s=samplehist(g,sp,prm,est,hw,&exact,st.th);
+	endphase(&st,PH_COMPUTE);
+	printtime(&t1);
+
+	if (exact){
+		printf("The samples would cost more than all the sources: computing the exact histogram\n");
+		if (mi->weight!=NULL){
+			nodeweights(g,mi->weight);
+			endphase(&st,PH_BUILD);
+		}
+		sc=mkschedule(g,0,nsources(g),lp.dmax,omp_get_max_threads());
+		endphase(&st,PH_SCHED);
+		hist=getkernel(&lp)(g,&lp,sc,st.th);
+		endphase(&st,PH_COMPUTE);
+		freeschedule(sc);
+		printtime(&t1);
+		freesampler(sp);
+		freegraph(g);
+		free(est);
+		free(hw);
+		return endrun(prm,&st,hist,t0,t1);
+	}
+
+	freesampler(sp);
+	freegraph(g);
+
+	t0=t1-t0;
+	printf("- Overall time = %ldh%ldm%lds\n",(long)t0/3600,((long)t0%3600)/60,(long)t0%60);
+	printestimate(prm,est,hw,s);
+	if (prm->report!=NULL){
+		hist=malloc(10*mi->nval*sizeof(unsigned long long));
+		for (i=0;i<10*mi->nval;i++)
+			hist[i]=llround(est[i]);
+		printf("Writing report in file %s\n",prm->report);
+		writereport(prm->report,&st,hist,mi->nval);
+		free(hist);
+	}
+	free(est);
+	free(hw);
+	freestats(&st);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+Cost-aware schedule of the sources, shared by the threads of a kernel (see kernel.h).
+
+The cost of a source u is its 2-hop estimate (wedges read): sum of d(v) over its neighbors v.
+Consecutive sources are grouped into tasks of about the same cost, and a source costing more than a task
+is split into parts (ranges of its neighbors) computed by different threads: each part exports its counters,
+the last part to finish merges them and evaluates the similarities of the source.
+*/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "graph.h"
+
+
+#define TASKSPERTHREAD 64
+#define MINTASKCOST 65536
+
+typedef struct {
+	unsigned u;//sources u..last-1
+	unsigned last;
+	unsigned split;//index of the split source, NONE if not split
+	unsigned part;//part of the split source: neighbors adj[i0..i1[
+	size_t i0;
+	size_t i1;
+} task;
+
+typedef struct {
+	unsigned nparts;
+	unsigned left;//parts not finished yet
+	unsigned *len;//number of counters exported by each part
+	unsigned **w;//nodes and counters exported by each part
+	void **c;
+} splitsource;
+
+typedef struct {
+	unsigned ntasks;
+	task *tasks;
+	unsigned nsplits;
+	splitsource *splits;
+} schedule;
+
+//2-hop estimate of u from its neighbors l[i0..i1[ (only those of original degree <= dmax)
+static inline unsigned long long wedgecost(graph *g,unsigned *l,unsigned i0,unsigned i1,unsigned dmax){
+	unsigned i,v;
+	unsigned long long c=0;
+	for (i=i0;i<i1;i++){
+		v=l[i];
+		if (g->d0[v]<=dmax)
+			c+=listlen(g,v);
+	}
+	return c;
+}
+
+//tasks of the sources lo..hi-1 (0..n-1 unless sharded, see shard.h)
+schedule* mkschedule(graph *g,unsigned lo,unsigned hi,unsigned dmax,unsigned nthreads){
+	schedule *s=malloc(sizeof(schedule));
+	unsigned long long *cost=malloc((hi-lo+1)*sizeof(unsigned long long)),tot=0,target,c;
+	unsigned u,i,t=0,tmax=1024,smax=16,*l,*buf=NULL,size=0;
+	splitsource *sp;
+
+	#pragma omp parallel private(l) reduction(+:tot)
+	{
+	unsigned *buf=NULL,size=0;
+	#pragma omp for schedule(dynamic, 1024)
+	for (u=lo;u<hi;u++){
+		l=neighbors(g,u,&buf,&size);
+		cost[u-lo]=wedgecost(g,l,0,listlen(g,u),dmax);
+		tot+=cost[u-lo];
+	}
+	free(buf);
+	}
+	target=tot/((unsigned long long)nthreads*TASKSPERTHREAD);
+	target=(target>MINTASKCOST)?target:MINTASKCOST;
+
+	s->tasks=malloc(tmax*sizeof(task));
+	s->splits=malloc(smax*sizeof(splitsource));
+	s->nsplits=0;
+	for (u=lo;u<hi;){
+		if (t+1>=tmax){
+			tmax*=2;
+			s->tasks=realloc(s->tasks,tmax*sizeof(task));
+		}
+		if (cost[u-lo]<=target){
+			s->tasks[t].u=u;
+			s->tasks[t].split=NONE;
+			for (c=0;u<hi && c+cost[u-lo]<=target;u++)
+				c+=cost[u-lo];
+			s->tasks[t++].last=u;
+			continue;
+		}
+		//split u in parts of about target wedges
+		if (s->nsplits==smax){
+			smax*=2;
+			s->splits=realloc(s->splits,smax*sizeof(splitsource));
+		}
+		sp=s->splits+s->nsplits;
+		sp->nparts=0;
+		l=neighbors(g,u,&buf,&size);
+		for (i=0;i<listlen(g,u);sp->nparts++){
+			if (t+1>=tmax){
+				tmax*=2;
+				s->tasks=realloc(s->tasks,tmax*sizeof(task));
+			}
+			s->tasks[t].u=u;
+			s->tasks[t].last=u+1;
+			s->tasks[t].split=s->nsplits;
+			s->tasks[t].part=sp->nparts;
+			s->tasks[t].i0=listoff(g,u)+i;
+			for (c=0;i<listlen(g,u) && c<target;i++)
+				c+=wedgecost(g,l,i,i+1,dmax);
+			s->tasks[t++].i1=listoff(g,u)+i;
+		}
+		sp->left=sp->nparts;
+		sp->len=calloc(sp->nparts,sizeof(unsigned));
+		sp->w=calloc(sp->nparts,sizeof(unsigned*));
+		sp->c=calloc(sp->nparts,sizeof(void*));
+		s->nsplits++;
+		u++;
+	}
+	s->ntasks=t;
+	free(cost);
+	free(buf);
+	return s;
+}
+
+void freeschedule(schedule *s){
+	unsigned k;
+	for (k=0;k<s->nsplits;k++){
+		free(s->splits[k].len);
+		free(s->splits[k].w);
+		free(s->splits[k].c);
+	}
+	free(s->splits);
+	free(s->tasks);
+	free(s);
+}
+
+#endif
@@ -0,0 +1,505 @@
+/*
+Similarity queries on a graph loaded once (simserver.c), answered on a local socket or on stdin/stdout.
+
+One query per line, one answer per line:
+- topk metric u k: the k nodes most similar to u, best first (by the first similarity for all)
+- pair metric u w: the similarities of u and w
+- above metric u a: the nodes with a similarity to u of at least a, best first
+- info: the number of nodes and edges
+A list of nodes is answered by its length followed by each node and its NVAL similarities, an error by "ERR ...".
+The nodes are the original IDs. The graph has the layout without degree ordering (sim.c): full lists of
+neighbors in decreasing order, so that the nodes similar to u are all its 2-hop neighbors.
+topk and above accumulate the common neighbors (or their weights) of u and each of them in the accumulator
+of the thread (see engine.h), topk keeps the k best ones in a bounded heap (topk.h), pair merges two lists.
+One thread polls the socket and the connections, and hands each complete query line to an OpenMP task, run
+by any of the n_threads threads of the pool with its own worker: its accumulator and buffers are reused by
+all the queries it answers. A connection has one query answered at a time (its answers in order), an idle
+or slow client holds no thread, and the queries of different connections are answered concurrently.
+Accept errors of the descriptors (EMFILE...) only pause the accepts until a connection is closed.
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "engine.h"
+#include "topk.h"
+
+
+typedef struct {
+	graph *g;
+	unsigned dmax;//only common neighbors with degree smaller or equal to dmax, NODMAX for all
+	unsigned hashmax;//nodes with a larger 2-hop estimate use dense accumulators
+	unsigned *label;//label of each original ID, NULL if the labels are the original IDs
+} server;
+
+//state of a thread of the pool, kept between its queries
+typedef struct {
+	accum acc;//counters in double
+	scored *res;//nodes of the answer
+	unsigned rmax;
+	unsigned *ubuf,usize,*vbuf,vsize;//decoded neighbors if compressed
+	char *out;//answer
+	size_t olen;
+	size_t omax;
+} worker;
+
+server* mkserver(graph *g,unsigned dmax,unsigned hashmax){
+	server *sv=malloc(sizeof(server));
+	unsigned u;
+	sv->g=g;
+	sv->dmax=dmax;
+	sv->hashmax=hashmax;
+	sv->label=NULL;
+	if (g->map!=NULL){
+		sv->label=malloc(g->n*sizeof(unsigned));
+		for (u=0;u<g->n;u++)
+			sv->label[g->map[u]]=u;
+	}
+	return sv;
+}
+
+void freeserver(server *sv){
+	free(sv->label);
+	free(sv);
+}
+
+void initworker(worker *wk){
+	bzero(wk,sizeof(worker));
+	initaccum(&wk->acc,sizeof(double));
+}
+
+void freeworker(worker *wk){
+	freeaccum(&wk->acc);
+	free(wk->res);
+	free(wk->ubuf);
+	free(wk->vbuf);
+	free(wk->out);
+}
+
+//append to the answer
+void answer(worker *wk,const char *fmt,...){
+	va_list ap;
+	int l;
+	va_start(ap,fmt);
+	l=vsnprintf(wk->out+wk->olen,wk->omax-wk->olen,fmt,ap);
+	va_end(ap);
+	if (wk->olen+l>=wk->omax){
+		wk->omax=(2*wk->omax>wk->olen+l+1)?2*wk->omax:wk->olen+l+1;
+		wk->out=realloc(wk->out,wk->omax);
+		va_start(ap,fmt);
+		vsnprintf(wk->out+wk->olen,wk->omax-wk->olen,fmt,ap);
+		va_end(ap);
+	}
+	wk->olen+=l;
+}
+
+//label of the original ID s, NONE if it is not a node
+unsigned parsenode(server *sv,char *s){
+	char *end;
+	unsigned long x=strtoul(s,&end,10);
+	if (end==s || *end!='\0' || x>=sv->g->n)
+		return NONE;
+	return (sv->label!=NULL)?sv->label[x]:x;
+}
+
+//weight of a common neighbor v
+static inline double nbweight(server *sv,metricinfo *mi,unsigned v){
+	return (mi->weight!=NULL)?mi->weight(sv->g->d0[v]):1.;
+}
+
+//c+x, rounded to float for weighted metrics as the kernel sums them (see ACC in kernel.h): the same values as the runs
+static inline double addweight(metricinfo *mi,double c,double x){
+	return (mi->weight!=NULL)?(float)(c+x):c+x;
+}
+
+//counters of the 2-hop neighbors of u (u excluded) in the accumulator of wk, returns their number
+unsigned accumulate(server *sv,worker *wk,metricinfo *mi,unsigned u,bool *hashed){
+	graph *g=sv->g;
+	unsigned i,j,k,v,w,n=0,mask,*nu,*nv,*list,*hkey;
+	unsigned hashmax=(sv->hashmax<g->n/256)?sv->hashmax:g->n/256;
+	unsigned long long est=0;
+	double x,*inter,*hval;
+
+	nu=neighbors(g,u,&wk->ubuf,&wk->usize);
+	for (i=0;i<listlen(g,u);i++){
+		if (g->d0[nu[i]]<=sv->dmax)
+			est+=listlen(g,nu[i]);
+	}
+	*hashed=(est<=hashmax);
+	mask=prepareaccum(&wk->acc,g->n,est,*hashed);
+	list=wk->acc.list;
+	inter=wk->acc.inter;
+	hkey=wk->acc.key;
+	hval=wk->acc.val;
+	for (i=0;i<listlen(g,u);i++){
+		v=nu[i];
+		if (g->d0[v]>sv->dmax)
+			continue;
+		x=nbweight(sv,mi,v);
+		nv=neighbors(g,v,&wk->vbuf,&wk->vsize);
+		for (j=0;j<listlen(g,v);j++){
+			w=nv[j];
+			if (w==u)
+				continue;
+			if (*hashed){
+				for (k=HASH(w)&mask;hkey[k]!=w;k=(k+1)&mask){
+					if (hkey[k]==EMPTY){
+						hkey[k]=w;
+						hval[k]=0;
+						list[n++]=k;
+						break;
+					}
+				}
+				hval[k]=addweight(mi,hval[k],x);
+			}
+			else {
+				if (inter[w]==0)
+					list[n++]=w;
+				inter[w]=addweight(mi,inter[w],x);
+			}
+		}
+	}
+	return n;
+}
+
+//node and counter c of the i-th entry of the accumulator, which is cleared
+static inline unsigned takecounter(accum *acc,unsigned i,bool hashed,double *c){
+	unsigned k,w;
+	if (hashed){
+		k=acc->list[i];
+		w=acc->key[k];
+		*c=((double*)acc->val)[k];
+		acc->key[k]=EMPTY;
+	}
+	else {
+		w=acc->list[i];
+		*c=((double*)acc->inter)[w];
+		((double*)acc->inter)[w]=0;
+	}
+	return w;
+}
+
+//nodes similar to u in wk->res, best first: the k best ones if k>0, else all those with a similarity of at least a
+unsigned similar(server *sv,worker *wk,metricinfo *mi,unsigned u,unsigned k,double a){
+	graph *g=sv->g;
+	unsigned i,w,n,l,nr=0;
+	double c,val[MAXVAL];
+	bool hashed;
+
+	n=accumulate(sv,wk,mi,u,&hashed);
+	l=(k>0 && k<n)?k:n;
+	if (wk->rmax<l){
+		free(wk->res);
+		wk->rmax=l;
+		wk->res=malloc(l*sizeof(scored));
+	}
+	for (i=0;i<n;i++){
+		w=takecounter(&wk->acc,i,hashed,&c);
+		mi->eval(val,c,g->d[u],g->d[w]);
+		if (k>0){
+			pushtopk(wk->res,&nr,k,w,nodeid(g,w),val[0],c);
+		}
+		else if (val[0]>=a){
+			wk->res[nr].val=val[0];
+			wk->res[nr].c=c;
+			wk->res[nr].id=nodeid(g,w);
+			wk->res[nr++].node=w;
+		}
+	}
+	sorttopk(wk->res,nr);
+	return nr;
+}
+
+//common neighbors (or their weights) of u and w, by merging their lists (in decreasing order)
+double paircount(server *sv,worker *wk,metricinfo *mi,unsigned u,unsigned w){
+	graph *g=sv->g;
+	unsigned i=0,j=0,du=listlen(g,u),dw=listlen(g,w);
+	unsigned *nu=neighbors(g,u,&wk->ubuf,&wk->usize),*nw=neighbors(g,w,&wk->vbuf,&wk->vsize);
+	double c=0;
+	while (i<du && j<dw) {
+		if (nu[i]>nw[j])
+			i++;
+		else if (nu[i]<nw[j])
+			j++;
+		else {
+			if (g->d0[nu[i]]<=sv->dmax)
+				c=addweight(mi,c,nbweight(sv,mi,nu[i]));
+			i++;
+			j++;
+		}
+	}
+	return c;
+}
+
+//the similarities of u and w from their counter c
+void answervals(server *sv,worker *wk,metricinfo *mi,unsigned u,unsigned w,double c){
+	unsigned k;
+	double val[MAXVAL];
+	mi->eval(val,c,sv->g->d[u],sv->g->d[w]);
+	for (k=0;k<mi->nval;k++)
+		answer(wk,(k>0)?" %g":"%g",val[k]);
+}
+
+//answer of the query s in wk->out
+void query(server *sv,worker *wk,char *s){
+	graph *g=sv->g;
+	char *tok[5],*save;
+	unsigned i,nt,u,w,k,nr;
+	int m;
+	metricinfo *mi;
+
+	wk->olen=0;
+	for (nt=0;nt<5 && (tok[nt]=strtok_r((nt==0)?s:NULL," \t\r\n",&save))!=NULL;nt++);
+	if (nt==1 && strcmp(tok[0],"info")==0){
+		answer(wk,"%u %zu\n",g->n,g->e);
+		return;
+	}
+	if (nt!=4){
+		answer(wk,"ERR expected: topk|pair|above metric node k|node|a, or info\n");
+		return;
+	}
+	if ((m=findmetric(tok[1]))<0){
+		answer(wk,"ERR unknown metric %s\n",tok[1]);
+		return;
+	}
+	mi=metrics+m;
+	if ((u=parsenode(sv,tok[2]))==NONE){
+		answer(wk,"ERR unknown node %s\n",tok[2]);
+		return;
+	}
+	if (strcmp(tok[0],"pair")==0){
+		if ((w=parsenode(sv,tok[3]))==NONE){
+			answer(wk,"ERR unknown node %s\n",tok[3]);
+			return;
+		}
+		answervals(sv,wk,mi,u,w,paircount(sv,wk,mi,u,w));
+		answer(wk,"\n");
+		return;
+	}
+	if (strcmp(tok[0],"topk")==0){
+		if ((k=atoi(tok[3]))<1){
+			answer(wk,"ERR k must be positive\n");
+			return;
+		}
+		nr=similar(sv,wk,mi,u,k,0.);
+	}
+	else if (strcmp(tok[0],"above")==0){
+		nr=similar(sv,wk,mi,u,0,atof(tok[3]));
+	}
+	else {
+		answer(wk,"ERR unknown query %s\n",tok[0]);
+		return;
+	}
+	answer(wk,"%u",nr);
+	for (i=0;i<nr;i++){
+		answer(wk," %u ",nodeid(g,wk->res[i].node));
+		answervals(sv,wk,mi,u,wk->res[i].node,wk->res[i].c);
+	}
+	answer(wk,"\n");
+}
+
+//answer the queries read on in on out, until the end of in or a failed write
+void serve(server *sv,worker *wk,FILE *in,int out){
+	char *line=NULL;
+	size_t len=0;
+	while (getline(&line,&len,in)>0) {
+		query(sv,wk,line);
+		if (!writeall(out,wk->out,wk->olen))
+			break;
+	}
+	free(line);
+}
+
+//local socket at path, listening, -1 if it failed
+int listenlocal(char *path){
+	struct sockaddr_un addr;
+	int fd;
+	if (strlen(path)>=sizeof(addr.sun_path) || (fd=socket(AF_UNIX,SOCK_STREAM,0))<0)
+		return -1;
+	bzero(&addr,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,path);
+	unlink(path);
+	if (bind(fd,(struct sockaddr*)&addr,sizeof(addr))<0 || listen(fd,SOMAXCONN)<0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//connection of the pool: its bytes not answered yet in in[0..len[, one query at a time in a task
+typedef struct {
+	int fd;
+	char *in;
+	size_t len;
+	size_t max;
+	bool busy;//a task answers its first query
+	bool eof;//closed by the client
+	bool failed;//an answer could not be written
+} conn;
+
+//length of the first query of c (with its newline), 0 if not complete
+static inline size_t firstquery(conn *c){
+	char *e=memchr(c->in,'\n',c->len);
+	if (e!=NULL)
+		return e-c->in+1;
+	return c->eof?c->len:0;
+}
+
+//answer the first query of c with the worker of the thread, and wake up the poll loop on done
+void answerfirst(server *sv,worker *wks,conn *c,int done){
+	worker *wk=wks+omp_get_thread_num();
+	size_t l=firstquery(c);
+	char z=0,*line=malloc(l+1);
+	memcpy(line,c->in,l);
+	line[l]=0;
+	query(sv,wk,line);
+	free(line);
+	if (!writeall(c->fd,wk->out,wk->olen))
+		c->failed=1;
+	c->len-=l;
+	memmove(c->in,c->in+l,c->len);
+	#pragma omp atomic write seq_cst
+	c->busy=0;
+	if (write(done,&z,1)<0 && errno!=EAGAIN)
+		perror("wake up");
+}
+
+//accept errors that do not come from the listening socket: the pool keeps going
+static inline bool transient(int err){
+	return err==EINTR || err==EAGAIN || err==ECONNABORTED || err==EMFILE || err==ENFILE || err==ENOBUFS || err==ENOMEM || err==EPROTO || err==EPERM;
+}
+
+//pool of the OpenMP threads: one thread polls lfd and the connections, and gives each query to a task answered
+//with the worker of the thread running it, the queries of a connection one after the other
+void servepool(server *sv,int lfd){
+	unsigned nthreads=omp_get_max_threads(),nc=0,cmax=16,i;
+	worker *wks=malloc((nthreads+1)*sizeof(worker));
+	conn **cs=malloc(cmax*sizeof(conn*)),*c;
+	struct pollfd *pfd=malloc((cmax+2)*sizeof(struct pollfd));
+	int wake[2],fd,err;
+	bool full=0,stop=0,busy;
+	char z[64];
+	ssize_t r;
+
+	if (pipe(wake)<0 || fcntl(wake[0],F_SETFL,O_NONBLOCK)<0 || fcntl(wake[1],F_SETFL,O_NONBLOCK)<0){
+		perror("pipe");
+		return;
+	}
+	for (i=0;i<=nthreads;i++)
+		initworker(wks+i);
+	//nthreads threads for the tasks, and the one polling
+	#pragma omp parallel num_threads(nthreads+1)
+	#pragma omp single
+	while (!stop || nc>0) {
+		//the connections whose query is answered: next query, or closed
+		for (i=0;i<nc;){
+			c=cs[i];
+			#pragma omp atomic read seq_cst
+			busy=c->busy;
+			if (busy){
+				i++;
+				continue;
+			}
+			if (!c->failed && firstquery(c)>0){
+				c->busy=1;
+				#pragma omp task firstprivate(c)
+				answerfirst(sv,wks,c,wake[1]);
+				i++;
+				continue;
+			}
+			if (c->failed || c->eof || stop){
+				close(c->fd);
+				free(c->in);
+				free(c);
+				cs[i]=cs[--nc];
+				full=0;
+				continue;
+			}
+			i++;
+		}
+		if (stop){
+			#pragma omp taskwait
+			continue;
+		}
+		pfd[0].fd=wake[0];
+		pfd[0].events=POLLIN;
+		pfd[1].fd=full?-1:lfd;
+		pfd[1].events=POLLIN;
+		for (i=0;i<nc;i++){
+			#pragma omp atomic read seq_cst
+			busy=cs[i]->busy;
+			pfd[i+2].fd=busy?-1:cs[i]->fd;
+			pfd[i+2].events=POLLIN;
+		}
+		//without connection to close, a full table of descriptors is tried again after a while
+		if (poll(pfd,nc+2,full?100:-1)<0){
+			if (errno!=EINTR){
+				perror("poll");
+				stop=1;
+			}
+			continue;
+		}
+		if (pfd[0].revents&POLLIN){
+			while (read(wake[0],z,sizeof(z))>0);
+		}
+		if (full && nc==0)
+			full=0;
+		for (i=0;i<nc;i++){
+			c=cs[i];
+			if (pfd[i+2].fd<0 || !(pfd[i+2].revents&(POLLIN|POLLHUP|POLLERR)))
+				continue;
+			if (c->len+4096>c->max){
+				c->max=2*c->max+4096;
+				c->in=realloc(c->in,c->max);
+			}
+			r=recv(c->fd,c->in+c->len,c->max-c->len,MSG_DONTWAIT);
+			if (r>0)
+				c->len+=r;
+			else if (r==0 || (errno!=EINTR && errno!=EAGAIN))
+				c->eof=1;
+		}
+		if (pfd[1].fd>=0 && (pfd[1].revents&POLLIN)){
+			if ((fd=accept(lfd,NULL,NULL))>=0){
+				if (nc==cmax){
+					cmax*=2;
+					cs=realloc(cs,cmax*sizeof(conn*));
+					pfd=realloc(pfd,(cmax+2)*sizeof(struct pollfd));
+				}
+				c=calloc(1,sizeof(conn));
+				c->fd=fd;
+				cs[nc++]=c;
+			}
+			else if (transient(err=errno)){
+				if (err==EMFILE || err==ENFILE || err==ENOBUFS || err==ENOMEM){
+					perror("accept");
+					full=1;
+				}
+			}
+			else {
+				perror("accept");
+				stop=1;
+			}
+		}
+	}
+	for (i=0;i<=nthreads;i++)
+		freeworker(wks+i);
+	free(wks);
+	free(cs);
+	free(pfd);
+	close(wake[0]);
+	close(wake[1]);
+}
+
+#endif
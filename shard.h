@@ -0,0 +1,85 @@
+/*
+Sharded computation in several processes on one machine (neighsim -P), see shardrun in engine.h.
+
+The coordinator maps the binary graph, cuts the sources 0..n-1 into ranges of about the same cost
+(2-hop estimate, see sched.h) and forks one worker per range. Each worker maps the same file, so that
+the graph is in memory once (page cache), computes its range with its own threads and sends back its
+result on a pipe: histogram, phase times and thread counters. The coordinator sums the histograms.
+A source is never split between shards: a single hub costing more than a shard unbalances them.
+*/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "graph.h"
+#include "sched.h"
+#include "report.h"
+
+
+//first source of each shard, bounds[nshards]=nsources
+//sequential: the coordinator must not start OpenMP threads before forking the workers
+unsigned* mkshards(graph *g,unsigned dmax,unsigned nshards){
+	unsigned *bounds=malloc((nshards+1)*sizeof(unsigned)),u,k=1,*l,*buf=NULL,size=0;
+	unsigned long long tot=0,c=0;
+
+	for (u=0;u<nsources(g);u++){
+		l=neighbors(g,u,&buf,&size);
+		tot+=wedgecost(g,l,0,listlen(g,u),dmax);
+	}
+	bounds[0]=0;
+	for (u=0;u<nsources(g) && k<nshards;u++){
+		l=neighbors(g,u,&buf,&size);
+		c+=wedgecost(g,l,0,listlen(g,u),dmax);
+		while (k<nshards && c*nshards>=tot*k)
+			bounds[k++]=u+1;
+	}
+	while (k<=nshards)
+		bounds[k++]=nsources(g);
+	free(buf);
+	return bounds;
+}
+
+//write or read len bytes on a pipe, 0 if it failed
+int writeall(int fd,void *p,size_t len){
+	size_t i=0;
+	ssize_t r;
+	while (i<len) {
+		r=write(fd,(char*)p+i,len-i);
+		if (r<=0)
+			return 0;
+		i+=r;
+	}
+	return 1;
+}
+
+int readall(int fd,void *p,size_t len){
+	size_t i=0;
+	ssize_t r;
+	while (i<len) {
+		r=read(fd,(char*)p+i,len-i);
+		if (r<=0)
+			return 0;
+		i+=r;
+	}
+	return 1;
+}
+
+//result of a worker: hist[10*nval], t[NPHASES], th[nthreads]
+int sendresult(int fd,unsigned long long *hist,unsigned nval,runstats *st){
+	return writeall(fd,hist,10*nval*sizeof(unsigned long long))
+		&& writeall(fd,st->t,NPHASES*sizeof(double))
+		&& writeall(fd,st->th,st->nthreads*sizeof(threadstats));
+}
+
+//the counters of the nthreads threads of the worker go to th
+int recvresult(int fd,unsigned long long *hist,unsigned nval,double *t,threadstats *th,unsigned nthreads){
+	return readall(fd,hist,10*nval*sizeof(unsigned long long))
+		&& readall(fd,t,NPHASES*sizeof(double))
+		&& readall(fd,th,nthreads*sizeof(threadstats));
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+gcc simclient.c -O9 -o simclient -fopenmp
+./simclient socket < queries
+./simclient -b clients queries [-q topk|pair|above] [-m metric] [-k k] [-a a] [-s seed] socket
+
+Client of simserver.c: sends the queries read on stdin (see server.h) and prints the answers, or with -b
+measures the latency under concurrent load: each of the clients (a thread with its own connection) sends
+its share of the queries one after the other, on random nodes, and waits for each answer.
+The latencies of all the queries give the percentiles, and their number over the elapsed time the throughput.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+
+
+void usage(char *prog){
+	fprintf(stderr,"%s socket < queries\n",prog);
+	fprintf(stderr,"%s -b clients queries [options] socket\n",prog);
+	fprintf(stderr,"-b clients queries: benchmark, this number of queries on random nodes sent by this number of concurrent clients\n");
+	fprintf(stderr,"-q query: topk, pair or above (default topk)\n");
+	fprintf(stderr,"-m metric: (default jaccard)\n");
+	fprintf(stderr,"-k k: for topk (default 10)\n");
+	fprintf(stderr,"-a a: for above (default 0.5)\n");
+	fprintf(stderr,"-s seed: of the random nodes (default 1)\n");
+	exit(1);
+}
+
+//monotonic clock in seconds
+double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+//connection to the local socket at path, -1 if it failed
+int connectlocal(char *path){
+	struct sockaddr_un addr;
+	int fd;
+	if (strlen(path)>=sizeof(addr.sun_path) || (fd=socket(AF_UNIX,SOCK_STREAM,0))<0)
+		return -1;
+	bzero(&addr,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,path);
+	if (connect(fd,(struct sockaddr*)&addr,sizeof(addr))<0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//send the query q on the connection fd and read its answer on f (reading fd), 0 if the connection failed
+int ask(int fd,FILE *f,char *q,char **ans,size_t *len){
+	size_t i=0,l=strlen(q);
+	ssize_t r;
+	while (i<l) {
+		if ((r=write(fd,q+i,l-i))<=0)
+			return 0;
+		i+=r;
+	}
+	return getline(ans,len,f)>0;
+}
+
+int compare_double(void const *a,void const *b){
+	double x=*(double const*)a,y=*(double const*)b;
+	return (x<y)?-1:(x>y);
+}
+
+//latency of a fraction p of the queries, in ms
+double percentile(double *lat,unsigned long n,double p){
+	unsigned long i=p*n;
+	return 1000.*lat[(i<n)?i:n-1];
+}
+
+int main(int argc,char** argv){
+	char *query="topk",*metric="jaccard",*line=NULL,*ans=NULL,q[256];
+	unsigned clients=0,k=10,seed=1,n=0,c;
+	unsigned long nq=0,i,errors=0;
+	double a=0.5,t0,*lat;
+	size_t len=0,llen=0;
+	int fd,opt,ok=1;
+	FILE *f;
+
+	while ((opt=getopt(argc,argv,"b:q:m:k:a:s:"))!=-1) {
+		switch (opt) {
+			case 'b':
+				if (optind>=argc)
+					usage(argv[0]);
+				clients=atoi(optarg);
+				nq=atol(argv[optind++]);
+				break;
+			case 'q':
+				query=optarg;
+				break;
+			case 'm':
+				metric=optarg;
+				break;
+			case 'k':
+				k=atoi(optarg);
+				break;
+			case 'a':
+				a=atof(optarg);
+				break;
+			case 's':
+				seed=atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc-optind<1)
+		usage(argv[0]);
+
+	if (clients==0){
+		if ((fd=connectlocal(argv[optind]))<0 || (f=fdopen(fd,"r"))==NULL){
+			perror(argv[optind]);
+			return 1;
+		}
+		while (getline(&line,&llen,stdin)>0) {
+			if (!ask(fd,f,line,&ans,&len)){
+				fprintf(stderr,"Connection closed\n");
+				return 1;
+			}
+			fputs(ans,stdout);
+		}
+		fclose(f);
+		free(line);
+		free(ans);
+		return 0;
+	}
+
+	if (nq<clients || (strcmp(query,"topk")!=0 && strcmp(query,"pair")!=0 && strcmp(query,"above")!=0))
+		usage(argv[0]);
+	if ((fd=connectlocal(argv[optind]))<0 || (f=fdopen(fd,"r"))==NULL || !ask(fd,f,"info\n",&ans,&len) || sscanf(ans,"%u",&n)!=1 || n==0){
+		fprintf(stderr,"Cannot get the number of nodes from %s\n",argv[optind]);
+		return 1;
+	}
+	fclose(f);
+	nq=nq/clients*clients;
+	lat=malloc(nq*sizeof(double));
+	printf("%lu %s %s queries on %u nodes from %u clients\n",nq,query,metric,n,clients);
+
+	omp_set_num_threads(clients);
+	t0=now();
+	#pragma omp parallel for schedule(static,1) private(i,f,q,fd) reduction(+:errors) reduction(&&:ok)
+	for (c=0;c<clients;c++){
+		unsigned r=seed*clients+c,u,w;
+		char *reply=NULL;
+		size_t l=0;
+		double t;
+		if ((fd=connectlocal(argv[optind]))<0 || (f=fdopen(fd,"r"))==NULL){
+			ok=0;
+			continue;
+		}
+		for (i=c*(nq/clients);i<(c+1)*(nq/clients);i++){
+			u=rand_r(&r)%n;
+			w=rand_r(&r)%n;
+			if (strcmp(query,"topk")==0)
+				sprintf(q,"topk %s %u %u\n",metric,u,k);
+			else if (strcmp(query,"pair")==0)
+				sprintf(q,"pair %s %u %u\n",metric,u,w);
+			else
+				sprintf(q,"above %s %u %g\n",metric,u,a);
+			t=now();
+			if (!ask(fd,f,q,&reply,&l)){
+				ok=0;
+				break;
+			}
+			lat[i]=now()-t;
+			if (strncmp(reply,"ERR",3)==0)
+				errors++;
+		}
+		fclose(f);
+		free(reply);
+	}
+	t0=now()-t0;
+	if (!ok){
+		fprintf(stderr,"A client lost its connection\n");
+		return 1;
+	}
+
+	qsort(lat,nq,sizeof(double),compare_double);
+	printf("Throughput: %.0f queries/s\n",nq/t0);
+	printf("Latency (ms): p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",percentile(lat,nq,0.5),percentile(lat,nq,0.9),percentile(lat,nq,0.99),percentile(lat,nq,1.));
+	printf("Errors (unknown nodes): %lu\n",errors);
+	free(lat);
+	free(ans);
+	return 0;
+}
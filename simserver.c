@@ -0,0 +1,90 @@
+/*
+gcc simserver.c -O9 -o simserver -lm -fopenmp
+./simserver [options] n_threads net.txt|net.bin socket
+./simserver [options] 1 net.txt|net.bin -
+
+Loads the graph once, without degree ordering (net.bin as written by sim or neighsim without -a),
+and answers the similarity queries (see server.h) of the clients of the local socket (see simclient.c)
+with a pool of n_threads threads, or the queries read on stdin with -, the messages going to stderr.
+*/
+
+#include <signal.h>
+
+#include "server.h"
+
+
+void usage(char *prog){
+	fprintf(stderr,"%s [options] n_threads net.txt|net.bin socket|-\n",prog);
+	fprintf(stderr,"-d dmax: only common neighbors with degree smaller or equal to dmax\n");
+	fprintf(stderr,"-H hashmax: nodes with a 2-hop estimate up to hashmax (and n/256) use a hash table instead of n-sized arrays (default %u, 0: never)\n",HASHMAX);
+	fprintf(stderr,"-z: compress the lists of neighbors (net.txt only)\n");
+	fprintf(stderr,"socket: path of the local socket, - for stdin/stdout\n");
+	exit(1);
+}
+
+int main(int argc,char** argv){
+	params prm=defaultparams();
+	graph *g;
+	server *sv;
+	worker wk;
+	runstats st;
+	double t1=now();
+	int c,out=STDOUT_FILENO,lfd;
+
+	while ((c=getopt(argc,argv,"d:H:z"))!=-1) {
+		switch (c) {
+			case 'd':
+				prm.dmax=atoi(optarg);
+				break;
+			case 'H':
+				prm.hashmax=atoi(optarg);
+				break;
+			case 'z':
+				prm.cmp=1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (argc-optind<3)
+		usage(argv[0]);
+	argc-=optind-1;
+	argv+=optind-1;
+
+	omp_set_num_threads(atoi(argv[1]));
+	signal(SIGPIPE,SIG_IGN);//a client leaving must not stop the server
+	if (strcmp(argv[3],"-")==0){
+		out=dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO,STDOUT_FILENO);
+	}
+
+	initstats(&st,1);
+	g=loadgraph(&prm,argv[2],NULL,&t1,&st);
+	freestats(&st);
+	if (g==NULL)
+		return 1;
+	printtime(&t1);
+	sv=mkserver(g,prm.dmax,prm.hashmax);
+
+	if (out!=STDOUT_FILENO){
+		printf("Answering the queries of stdin\n");
+		fflush(stdout);
+		initworker(&wk);
+		serve(sv,&wk,stdin,out);
+		freeworker(&wk);
+	}
+	else {
+		if ((lfd=listenlocal(argv[3]))<0){
+			perror(argv[3]);
+			return 1;
+		}
+		printf("Answering the queries of socket %s with %d threads\n",argv[3],omp_get_max_threads());
+		fflush(stdout);
+		servepool(sv,lfd);
+		close(lfd);
+	}
+
+	freeserver(sv);
+	freegraph(g);
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+Finer statistics of the pairs counted by the kernels (neighsim -B bins, -Q, -S), in the same pass as the histogram:
+- bins: number of pairs in bins of arbitrary edges "e0,e1,...,ek" (]e_i, e_i+1]), or "lo:hi:n" for n bins of the same
+  width, or "log:lo:hi:n" for n bins with edges in geometric progression, the values <= e0 and > ek counted apart
+- quantiles: sketch of the values in log-linear bins (as HDR histograms): each power of 2 cut in 2^SKSUB bins of
+  the same width, found from the exponent and the first bits of the mantissa of the value, without computing
+  a logarithm. The value of any quantile is known within a relative error of 2^-(SKSUB+1), whatever the number
+  of pairs, and two sketches are merged exactly by adding their counts
+- degree strata: the 10 buckets of the first similarity for each pair of degree classes (floor(log2 d(u)),
+  floor(log2 d(w))) with d(u)<=d(w), e.g. whether the very similar pairs are pairs of small nodes
+All of them are counters: each thread of a kernel fills its own copy, and the copies are added bin by bin after
+the kernel, the bins being shared between the threads (mergefine), instead of one thread after the other.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+
+#define SKSUB 7 //bits of the mantissa in the bins of the sketch: relative error of the quantiles 2^-(SKSUB+1)
+#define SKEMIN -30 //values below 2^SKEMIN are counted as 0 by the sketch
+#define SKEMAX 30 //values from 2^(SKEMAX+1) are counted in the last bin
+#define DCLASSES 32 //degree classes: floor(log2 d)
+
+typedef struct {
+	unsigned nval;//similarities per pair
+	unsigned nb;//bins, 0 for none
+	double *edges;//nb+1 edges of the bins
+	int sketch;//quantile sketch
+	int strata;//histograms by degree classes
+	unsigned nsk;//bins of the sketch, the first one for the values below 2^SKEMIN
+	size_t len;//counters: nval*(nb+2) bins (below e0 first, above ek last), nval*nsk sketch bins, strata
+	size_t osk,ost;//offsets of the sketch and of the strata
+	unsigned long long *res;//counters of the whole run
+} finestats;
+
+//edges of the bins described by spec, their number minus 1 in *nb, NULL if spec is not valid
+double* parsebins(char *spec,unsigned *nb){
+	double *e=NULL,lo,hi;
+	unsigned i,n;
+	char *p,*end;
+	int lg=(strncmp(spec,"log:",4)==0);
+	if (lg || strchr(spec,':')!=NULL){
+		if (sscanf(spec+(lg?4:0),"%lf:%lf:%u",&lo,&hi,&n)!=3 || n<1 || hi<=lo || (lg && lo<=0))
+			return NULL;
+		e=malloc((n+1)*sizeof(double));
+		for (i=0;i<=n;i++)
+			e[i]=lg?lo*pow(hi/lo,(double)i/n):lo+(hi-lo)*i/n;
+		e[n]=hi;
+		*nb=n;
+		return e;
+	}
+	for (n=0,p=spec;;n++){
+		e=realloc(e,(n+1)*sizeof(double));
+		e[n]=strtod(p,&end);
+		if (end==p || (n>0 && e[n]<=e[n-1]) || (*end!=',' && *end!='\0')){
+			free(e);
+			return NULL;
+		}
+		if (*end=='\0')
+			break;
+		p=end+1;
+	}
+	if (n<1){
+		free(e);
+		return NULL;
+	}
+	*nb=n;
+	return e;
+}
+
+//statistics of nval similarities: bins described by spec (NULL for none), quantile sketch, degree strata
+//NULL if spec is not valid
+finestats* mkfine(unsigned nval,char *spec,int sketch,int strata){
+	finestats *fs=calloc(1,sizeof(finestats));
+	fs->nval=nval;
+	if (spec!=NULL && (fs->edges=parsebins(spec,&fs->nb))==NULL){
+		free(fs);
+		return NULL;
+	}
+	fs->sketch=sketch;
+	fs->strata=strata;
+	fs->nsk=sketch?((SKEMAX-SKEMIN+1)<<SKSUB)+1:0;
+	fs->osk=(fs->nb>0)?nval*(fs->nb+2):0;
+	fs->ost=fs->osk+nval*fs->nsk;
+	fs->len=fs->ost+(strata?DCLASSES*DCLASSES*10:0);
+	fs->res=calloc(fs->len,sizeof(unsigned long long));
+	return fs;
+}
+
+void freefine(finestats *fs){
+	free(fs->edges);
+	free(fs->res);
+	free(fs);
+}
+
+//bin of x: 0 if x<=e0, i+1 if e_i<x<=e_i+1, nb+1 if x>ek
+static inline unsigned finebin(finestats *fs,double x){
+	unsigned lo=0,hi=fs->nb,mid;
+	if (x<=fs->edges[0])
+		return 0;
+	if (x>fs->edges[fs->nb])
+		return fs->nb+1;
+	while (lo+1<hi) {//edges[lo]<x<=edges[hi]
+		mid=(lo+hi)/2;
+		if (x<=fs->edges[mid])
+			hi=mid;
+		else
+			lo=mid;
+	}
+	return hi;
+}
+
+//sketch bin of x: 0 if x<2^SKEMIN, else 1+(e-SKEMIN)*2^SKSUB+s for x in [2^e*(1+s/2^SKSUB), 2^e*(1+(s+1)/2^SKSUB)[
+static inline unsigned sketchbin(finestats *fs,double x){
+	unsigned long long b;
+	int e;
+	memcpy(&b,&x,sizeof(double));
+	e=(int)((b>>52)&0x7ff)-1023;
+	if (x<=0 || e<SKEMIN)
+		return 0;
+	if (e>SKEMAX)
+		return fs->nsk-1;
+	return 1+((unsigned)(e-SKEMIN)<<SKSUB)+(unsigned)((b>>(52-SKSUB))&((1<<SKSUB)-1));
+}
+
+static inline unsigned degclass(unsigned d){
+	return (d>0)?31-__builtin_clz(d):0;
+}
+
+//count the pair of similarities val and degrees du, dw in the counters c of a thread
+static inline void addfine(finestats *fs,unsigned long long *c,double *val,unsigned du,unsigned dw){
+	unsigned k,cu,cw;
+	for (k=0;k<fs->nval;k++){
+		if (fs->nb>0)
+			c[k*(fs->nb+2)+finebin(fs,val[k])]++;
+		if (fs->sketch)
+			c[fs->osk+k*fs->nsk+sketchbin(fs,val[k])]++;
+	}
+	if (fs->strata){
+		cu=degclass((du<dw)?du:dw);
+		cw=degclass((du<dw)?dw:du);
+		c[fs->ost+10*(cu*DCLASSES+cw)+((val[0]>0.9)?9:(unsigned)floor(val[0]*10))]++;
+	}
+}
+
+//add the counters of the threads (NULL for the threads that did not run) to fs->res and free them
+void mergefine(finestats *fs,unsigned long long **c,unsigned nthreads){
+	size_t j;
+	unsigned p;
+	#pragma omp parallel for private(p) schedule(static)
+	for (j=0;j<fs->len;j++){
+		for (p=0;p<nthreads;p++){
+			if (c[p]!=NULL)
+				fs->res[j]+=c[p][j];
+		}
+	}
+	for (p=0;p<nthreads;p++)
+		free(c[p]);
+}
+
+//value of quantile q of similarity k from the sketch
+double quantile(finestats *fs,unsigned k,double q){
+	unsigned long long *c=fs->res+fs->osk+k*fs->nsk,tot=0,cum=0;
+	unsigned j;
+	double r;
+	for (j=0;j<fs->nsk;j++)
+		tot+=c[j];
+	if (tot==0)
+		return 0.;
+	r=q*(tot-1);
+	for (j=0;j<fs->nsk;j++){
+		cum+=c[j];
+		if (cum>r)
+			break;
+	}
+	if (j==0)
+		return 0.;
+	//middle of the bin
+	j--;
+	return ldexp(1.+((j&((1<<SKSUB)-1))+0.5)/(1<<SKSUB),(int)(j>>SKSUB)+SKEMIN);
+}
+
+//print the statistics of the similarities called desc (the first one named first in the strata), at most 1 if norm
+void printfine(finestats *fs,const char *desc,const char *first,int norm){
+	static const double qs[]={0.01,0.05,0.1,0.25,0.5,0.75,0.9,0.95,0.99,0.999};
+	unsigned i,j,k;
+	unsigned long long *c;
+	double x;
+
+	if (fs->nb>0){
+		printf("Number of %s similarities in the bins\n",desc);
+		for (i=0;i<fs->nb+2;i++){
+			if (i==0)
+				printf("<= %g = ",fs->edges[0]);
+			else if (i==fs->nb+1)
+				printf("> %g = ",fs->edges[fs->nb]);
+			else
+				printf("]%g, %g] = ",fs->edges[i-1],fs->edges[i]);
+			for (k=0;k<fs->nval;k++)
+				printf((k+1<fs->nval)?"%llu, ":"%llu\n",fs->res[k*(fs->nb+2)+i]);
+		}
+	}
+	if (fs->sketch){
+		printf("Quantiles of the %s similarities (relative error %g)\n",desc,1./(2<<SKSUB));
+		for (i=0;i<sizeof(qs)/sizeof(double);i++){
+			printf("%g%% = ",100.*qs[i]);
+			for (k=0;k<fs->nval;k++){
+				x=quantile(fs,k,qs[i]);
+				printf((k+1<fs->nval)?"%.6g, ":"%.6g\n",(norm && x>1.)?1.:x);
+			}
+		}
+	}
+	if (fs->strata){
+		printf("Number of %s similarities in each bucket by degree classes [2^i, 2^(i+1)[ of the pairs, d(u) <= d(w)\n",first);
+		for (i=0;i<DCLASSES;i++){
+			for (j=i;j<DCLASSES;j++){
+				c=fs->res+fs->ost+10*(i*DCLASSES+j);
+				for (k=0;k<10 && c[k]==0;k++);
+				if (k==10)
+					continue;
+				printf("[%llu, %llu[ x [%llu, %llu[ =",1ULL<<i,2ULL<<i,1ULL<<j,2ULL<<j);
+				for (k=0;k<10;k++)
+					printf((k<9)?" %llu,":" %llu\n",c[k]);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+Bounded selection of the k most similar nodes (see server.h, kernel.h): a heap of at most k scored nodes
+whose root is the worst kept one, replaced as soon as a better one comes, in O(log k).
+A node is better than another if its similarity is larger, or equal with a smaller original ID,
+so that the selection depends neither on the order in which the nodes come nor on their labels (degree
+ordering, -r).
+*/
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stdlib.h>
+
+
+typedef struct {
+	double val;//similarity ranking the nodes (the first one for all)
+	double c;//counter of common neighbors it comes from, giving the other ones
+	unsigned node;
+	unsigned id;//original ID of the node, ordering the ties
+} scored;
+
+static inline int better(scored *x,scored *y){
+	return x->val>y->val || (x->val==y->val && x->id<y->id);
+}
+
+//move h[i] down to its place, the subtrees of its children being heaps
+static inline void siftdown(scored *h,unsigned n,unsigned i){
+	unsigned c;
+	scored x=h[i];
+	while ((c=2*i+1)<n) {
+		if (c+1<n && better(h+c,h+c+1))
+			c++;//worst child
+		if (better(h+c,&x))
+			break;
+		h[i]=h[c];
+		i=c;
+	}
+	h[i]=x;
+}
+
+//add node w (original ID id) of similarity val (from counter c) to the heap h of *n<=k nodes
+static inline void pushtopk(scored *h,unsigned *n,unsigned k,unsigned w,unsigned id,double val,double c){
+	unsigned i,p;
+	scored x={val,c,w,id};
+	if (*n<k){
+		for (i=(*n)++;i>0 && better(h+(p=(i-1)/2),&x);i=p)
+			h[i]=h[p];
+		h[i]=x;
+	}
+	else if (k>0 && better(&x,h)){
+		h[0]=x;
+		siftdown(h,*n,0);
+	}
+}
+
+int compare_scored(void const *a,void const *b){
+	scored *x=(scored*)a,*y=(scored*)b;
+	return better(y,x)-better(x,y);
+}
+
+//best first
+void sorttopk(scored *h,unsigned n){
+	qsort(h,n,sizeof(scored),compare_scored);
+}
+
+#endif
@@ -0,0 +1,530 @@
+/*
+Incremental update (neighsim -u batch): the change of the histogram and of the pairs made by a batch of
+edge insertions and deletions, from the graph before it, instead of a full run on the graph after it.
+
+The batch has one change per line: "+ u w" inserts the edge u-w, "- u w" deletes it. The last change of an
+edge wins, inserting an edge already there or deleting a missing one does nothing.
+The similarities of u and w only depend on d(u), d(w) and their common neighbors, which only change if u or w
+is an endpoint of a changed edge: the affected pairs are the pairs of an endpoint and its 2-hop neighbors,
+before or after the batch. An endpoint whose degree changes the weight of a common neighbor (weighted metrics)
+or crosses dmax changes all the pairs of its neighbors, which are then affected too.
+Each affected node u counts its 2-hop neighbors in both graphs as the queries do (see server.h), a pair of two
+affected nodes being counted from the smaller one. The pairs whose similarities differ move from their old
+bucket to their new one, and are written in prefix.del.<thread> (old values, to remove from the pairs of
+the previous run) and prefix.add.<thread> (new values, to add). The graph after the batch is written in
+binary for the next batch, and the histogram of the previous run (its output, -b) is updated.
+*/
+
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "server.h"
+
+
+typedef struct {
+	unsigned s;//s>t
+	unsigned t;
+	unsigned line;
+	char op;//'+' or '-', 0 if it does nothing
+} change;
+
+typedef struct {
+	unsigned node;
+	double c;
+} counter;
+
+int compare_change(void const *a,void const *b){
+	change const *x=a,*y=b;
+	if (x->s!=y->s)
+		return (x->s<y->s)?-1:1;
+	if (x->t!=y->t)
+		return (x->t<y->t)?-1:1;
+	return (x->line<y->line)?-1:(x->line>y->line);
+}
+
+int compare_counter(void const *a,void const *b){
+	counter const *x=a,*y=b;
+	return (x->node<y->node)?-1:(x->node>y->node);
+}
+
+//changes of the batch in path, sorted, the last one of each edge only, NULL if it cannot be read
+//*n is increased to the largest node plus one
+change* readbatch(char *path,size_t *nc,unsigned *n){
+	FILE *file=fopen(path,"r");
+	char *line=NULL,op;
+	size_t len=0,max=1024,i,j;
+	unsigned u,w,l=0;
+	change *ch;
+
+	if (file==NULL)
+		return NULL;
+	ch=malloc(max*sizeof(change));
+	*nc=0;
+	while (getline(&line,&len,file)>0) {
+		l++;
+		if (sscanf(line," %c %u %u",&op,&u,&w)!=3 || (op!='+' && op!='-') || u==w)
+			continue;//comments, self-loops
+		if (*nc==max){
+			max*=2;
+			ch=realloc(ch,max*sizeof(change));
+		}
+		ch[*nc].s=(u>w)?u:w;
+		ch[*nc].t=(u>w)?w:u;
+		ch[*nc].line=l;
+		ch[(*nc)++].op=op;
+		*n=(ch[*nc-1].s>=*n)?ch[*nc-1].s+1:*n;
+	}
+	free(line);
+	fclose(file);
+	qsort(ch,*nc,sizeof(change),compare_change);
+	for (i=0,j=0;i<*nc;i++){
+		if (i+1<*nc && ch[i+1].s==ch[i].s && ch[i+1].t==ch[i].t)
+			continue;
+		ch[j++]=ch[i];
+	}
+	*nc=j;
+	return ch;
+}
+
+//change of the edge s-t (s>t), NULL if none
+change* findchange(change *ch,size_t nc,unsigned s,unsigned t){
+	size_t lo=0,hi=nc,mid;
+	while (lo<hi) {
+		mid=lo+(hi-lo)/2;
+		if (ch[mid].s<s || (ch[mid].s==s && ch[mid].t<t))
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	return (lo<nc && ch[lo].s==s && ch[lo].t==t)?ch+lo:NULL;
+}
+
+//true if u-v is an edge of g (lists in decreasing order)
+int hasedge(graph *g,unsigned u,unsigned v,unsigned **buf,unsigned *size){
+	unsigned lo=0,hi,mid,*nu;
+	if (u>=g->n || v>=g->n)
+		return 0;
+	nu=neighbors(g,u,buf,size);
+	hi=listlen(g,u);
+	while (lo<hi) {
+		mid=lo+(hi-lo)/2;
+		if (nu[mid]>v)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	return lo<listlen(g,u) && nu[lo]==v;
+}
+
+//graph of n nodes after the batch: the edges s-t (s>t) of g without the deleted ones, then the inserted ones
+//the changes doing nothing are cleared, *ins and *del count the others
+graph* applybatch(graph *g,change *ch,size_t nc,unsigned n,params *prm,size_t *ins,size_t *del){
+	graph *h=calloc(1,sizeof(graph));
+	size_t i,k,*off=malloc(((size_t)g->n+1)*sizeof(size_t));
+	unsigned u,pass,*cnt=calloc(g->n,sizeof(unsigned));
+	size_t ni=0,nd=0;
+
+	#pragma omp parallel
+	{
+	unsigned *buf=NULL,size=0;
+	int there;
+	#pragma omp for schedule(dynamic, 256) reduction(+:ni,nd)
+	for (i=0;i<nc;i++){
+		there=hasedge(g,ch[i].s,ch[i].t,&buf,&size);
+		if ((ch[i].op=='+')==there)
+			ch[i].op=0;
+		else if (ch[i].op=='+')
+			ni++;
+		else
+			nd++;
+	}
+	free(buf);
+	}
+	*ins=ni;
+	*del=nd;
+
+	//edges s-t of g kept, s>t (a self-loop u-u is twice in the list of u): counted, then written from off[s]
+	for (pass=0;pass<2;pass++){
+		#pragma omp parallel private(i,k)
+		{
+		unsigned *buf=NULL,size=0,*nu,v,loops;
+		change *c;
+		#pragma omp for schedule(dynamic, 1024)
+		for (u=0;u<g->n;u++){
+			nu=neighbors(g,u,&buf,&size);
+			for (i=listlen(g,u),k=(pass==0)?0:off[u],loops=0;i>0 && (v=nu[i-1])<=u;i--){
+				if (v==u && (loops++)%2==1)
+					continue;
+				if (v<u && (c=findchange(ch,nc,u,v))!=NULL && c->op=='-')
+					continue;
+				if (pass==1){
+					h->edges[k].s=u;
+					h->edges[k].t=v;
+				}
+				k++;
+			}
+			if (pass==0)
+				cnt[u]=k;
+		}
+		free(buf);
+		}
+		if (pass==0){
+			prefixsum(cnt,NULL,off,g->n);
+			h->e=off[g->n]+ni;
+			h->edges=malloc(h->e*sizeof(edge));
+		}
+	}
+	for (i=0,k=off[g->n];i<nc;i++){
+		if (ch[i].op=='+'){
+			h->edges[k].s=ch[i].s;
+			h->edges[k++].t=ch[i].t;
+		}
+	}
+	free(cnt);
+	free(off);
+
+	h->n=(n>g->n)?n:g->n;
+	h->d0=mkcsr(h,1);
+	if (prm->dmax!=NODMAX){
+		filterdeg(h,prm->dmax);
+	}
+	else {
+		h->d=h->d0;
+	}
+	free(h->edges);
+	h->edges=NULL;
+	if (g->cadj!=NULL)
+		compress(h,1);
+	return h;
+}
+
+//the endpoints of the changes and, if their degree change changes the pairs of their neighbors, these neighbors
+//returns aff (aff[u] true if u is affected) and the affected nodes in increasing order in *list
+bool* affected(graph *g,graph *h,change *ch,size_t nc,params *prm,unsigned **list,unsigned *na){
+	bool *aff=calloc(h->n,sizeof(bool)),weighted=(metrics[prm->metric].weight!=NULL);
+	unsigned u,x,d0,k,*buf=NULL,size=0,*nx;
+	size_t i;
+
+	for (i=0;i<nc;i++){
+		if (ch[i].op!=0){
+			aff[ch[i].s]=1;
+			aff[ch[i].t]=1;
+		}
+	}
+	for (i=0;i<2*nc;i++){
+		if (ch[i/2].op==0)
+			continue;
+		x=(i%2==0)?ch[i/2].s:ch[i/2].t;
+		d0=(x<g->n)?g->d0[x]:0;
+		if (!(weighted && d0!=h->d0[x]) && (d0<=prm->dmax)==(h->d0[x]<=prm->dmax))
+			continue;
+		if (x<g->n){
+			nx=neighbors(g,x,&buf,&size);
+			for (k=0;k<listlen(g,x);k++)
+				aff[nx[k]]=1;
+		}
+		nx=neighbors(h,x,&buf,&size);
+		for (k=0;k<listlen(h,x);k++)
+			aff[nx[k]]=1;
+	}
+	free(buf);
+
+	*na=0;
+	for (u=0;u<h->n;u++)
+		*na+=aff[u];
+	*list=malloc(*na*sizeof(unsigned));
+	for (u=0,k=0;u<h->n;u++){
+		if (aff[u])
+			(*list)[k++]=u;
+	}
+	return aff;
+}
+
+//counters of the pairs of u counted from u, in increasing order of the other node, in *buf (of *size counters)
+unsigned counters(server *sv,worker *wk,metricinfo *mi,unsigned u,bool *aff,counter **buf,unsigned *size){
+	unsigned i,w,n,l=0;
+	double c;
+	bool hashed;
+
+	n=accumulate(sv,wk,mi,u,&hashed);
+	if (*size<n){
+		*size=n;
+		free(*buf);
+		*buf=malloc(n*sizeof(counter));
+	}
+	for (i=0;i<n;i++){
+		w=takecounter(&wk->acc,i,hashed,&c);
+		if (aff[w] && w<u)
+			continue;//counted from w
+		(*buf)[l].node=w;
+		(*buf)[l++].c=c;
+	}
+	qsort(*buf,l,sizeof(counter),compare_counter);
+	return l;
+}
+
+//change of the histogram made by the batch (g before it, h after it) for the affected nodes, pairs in prm->prefix.del/add
+long long* updatepairs(graph *g,graph *h,params *prm,bool *aff,unsigned *list,unsigned na,threadstats *th,unsigned long long *cnt){
+	metricinfo *mi=metrics+prm->metric;
+	unsigned i,nval=mi->nval;
+	long long *dh=calloc(10*nval,sizeof(long long));
+	server *sg=mkserver(g,prm->dmax,prm->hashmax),*sh=mkserver(h,prm->dmax,prm->hashmax);
+	char *pdel=NULL,*padd=NULL;
+	unsigned long long removed=0,added=0,changed=0;
+
+	if (prm->prefix!=NULL){
+		pdel=malloc(strlen(prm->prefix)+8);
+		padd=malloc(strlen(prm->prefix)+8);
+		sprintf(pdel,"%s.del",prm->prefix);
+		sprintf(padd,"%s.add",prm->prefix);
+	}
+
+	#pragma omp parallel reduction(+:removed,added,changed)
+	{
+	worker wb,wa;
+	counter *cb=NULL,*ca=NULL;
+	unsigned sizeb=0,sizea=0,u,w,nb,nc,j,k,l,p=omp_get_thread_num();
+	double vb[MAXVAL],va[MAXVAL],t0=now();
+	bool old,new;
+	long long *dh_p=calloc(10*nval,sizeof(long long));
+	pairfile *fdel=(pdel!=NULL)?openpairs(pdel,p,prm->text,nval,0):NULL;
+	pairfile *fadd=(padd!=NULL)?openpairs(padd,p,prm->text,nval,0):NULL;
+	initworker(&wb);
+	initworker(&wa);
+
+	#pragma omp for schedule(dynamic, 1)
+	for (i=0;i<na;i++){
+		u=list[i];
+		nb=(u<g->n)?counters(sg,&wb,mi,u,aff,&cb,&sizeb):0;
+		nc=counters(sh,&wa,mi,u,aff,&ca,&sizea);
+		th[p].cands+=nb+nc;
+		for (j=0,k=0;j<nb || k<nc;){
+			old=(j<nb && (k==nc || cb[j].node<=ca[k].node));
+			new=(k<nc && (j==nb || ca[k].node<=cb[j].node));
+			w=old?cb[j].node:ca[k].node;
+			if (old)
+				mi->eval(vb,cb[j++].c,g->d[u],g->d[w]);
+			if (new)
+				mi->eval(va,ca[k++].c,h->d[u],h->d[w]);
+			if (old && new && memcmp(vb,va,nval*sizeof(double))==0)
+				continue;
+			for (l=0;l<nval;l++){
+				if (old)
+					dh_p[10*l+bucket(vb[l])]--;
+				if (new)
+					dh_p[10*l+bucket(va[l])]++;
+			}
+			removed+=old && !new;
+			added+=new && !old;
+			changed+=old && new;
+			if (fdel!=NULL && old && vb[0]>=prm->a){
+				writepair(fdel,(u<w)?u:w,(u<w)?w:u,vb);
+				th[p].pairs++;
+			}
+			if (fadd!=NULL && new && va[0]>=prm->a){
+				writepair(fadd,(u<w)?u:w,(u<w)?w:u,va);
+				th[p].pairs++;
+			}
+		}
+	}
+	th[p].busy+=now()-t0;
+	if (fdel!=NULL){
+		closepairs(fdel);
+		closepairs(fadd);
+	}
+	freeworker(&wb);
+	freeworker(&wa);
+	free(cb);
+	free(ca);
+	#pragma omp critical
+	{
+		for (l=0;l<10*nval;l++){
+			dh[l]+=dh_p[l];
+		}
+		free(dh_p);
+	}
+	}
+	cnt[0]=removed;
+	cnt[1]=added;
+	cnt[2]=changed;
+	freeserver(sg);
+	freeserver(sh);
+	free(pdel);
+	free(padd);
+	return dh;
+}
+
+//histogram of the metric in the output of a run (the last one printed by printhist), 0 if there is none
+int readhist(char *path,metricinfo *mi,unsigned long long *hist){
+	FILE *file=fopen(path,"r");
+	char *line=NULL,*p,*end,head[256];
+	size_t len=0;
+	unsigned i=10,k,found=0;
+
+	if (file==NULL)
+		return 0;
+	snprintf(head,sizeof(head),"Number of %s similarities in",mi->desc);
+	while (getline(&line,&len,file)>0) {
+		if (strncmp(line,head,strlen(head))==0){
+			i=0;
+			continue;
+		}
+		if (i==10)
+			continue;
+		if ((p=strstr(line,"= "))==NULL){
+			i=10;
+			continue;
+		}
+		for (k=0,p+=2;k<mi->nval;k++,p=end+1){
+			hist[10*k+i]=strtoull(p,&end,10);
+			if (end==p)
+				break;
+		}
+		i=(k==mi->nval)?i+1:10;
+		found+=(i==10 && k==mi->nval);
+	}
+	free(line);
+	fclose(file);
+	return found>0;
+}
+
+void printdelta(metricinfo *mi,long long *dh){
+	unsigned i,k;
+	long long tot=0;
+
+	printf("Change of the number of %s similarities in\n",mi->desc);
+	for (i=0;i<10;i++){
+		if (i==9 && !mi->norm){
+			printf("]0.9, +inf[ = ");
+		}
+		else {
+			printf("]0.%u, %s%u] = ",i,(i<9)?"0.":"1.",(i+1)%10);
+		}
+		for (k=0;k<mi->nval;k++){
+			printf((k+1<mi->nval)?"%+lld, ":"%+lld\n",dh[10*k+i]);
+		}
+		tot+=dh[i];
+	}
+	printf("Change of the number of non-zero similarities = %+lld\n",tot);
+}
+
+//incremental run: the graph before the batch from input, the graph after it written in binout if not NULL
+int updaterun(params *prm,char *input,char *binout){
+	params lp=*prm;
+	metricinfo *mi=metrics+prm->metric;
+	graph *g,*h;
+	change *ch;
+	runstats st;
+	size_t nc,ins,del;
+	unsigned n=0,na,k,*list;
+	unsigned long long *hist=NULL,cnt[3];
+	long long *dh;
+	bool *aff;
+	double t0,t1;
+	t1=now();
+	t0=t1;
+
+	if (prm->join || prm->topk>0 || prm->budget>0 || prm->nshards>1 || prm->order!=ORD_NONE || prm->dir!=DIR_NONE){
+		fprintf(stderr,"Incremental update in memory, without -x, -k, -M, -P, -r or -D\n");
+		return 1;
+	}
+	if (prm->base!=NULL){
+		hist=malloc(10*mi->nval*sizeof(unsigned long long));
+		if (!readhist(prm->base,mi,hist)){
+			fprintf(stderr,"No histogram of %s similarities in %s\n",mi->desc,prm->base);
+			free(hist);
+			return 1;
+		}
+	}
+	else if (prm->report!=NULL){
+		fprintf(stderr,"The report of an incremental update needs the histogram before the batch (-b)\n");
+		return 1;
+	}
+	if ((ch=readbatch(prm->batch,&nc,&n))==NULL){
+		fprintf(stderr,"Cannot read batch %s\n",prm->batch);
+		free(hist);
+		return 1;
+	}
+	initstats(&st,omp_get_max_threads());
+	st.input=input;
+	st.metric=mi->name;
+	st.a=prm->a;
+	st.dmax=prm->dmax;
+	if (prm->dmax!=NODMAX){
+		printf("Only taking into account common neighbors with degree <= %u\n",prm->dmax);
+	}
+
+	//full lists without degree ordering, a only selects the pairs written
+	lp.a=0;
+	g=loadgraph(&lp,input,NULL,&t1,&st);
+	if (g!=NULL && g->map!=NULL){
+		fprintf(stderr,"Incremental update of a graph without relabeling (-r) only\n");
+		freegraph(g);
+		g=NULL;
+	}
+	if (g==NULL){
+		free(ch);
+		free(hist);
+		freestats(&st);
+		return 1;
+	}
+	printtime(&t1);
+
+	printf("Applying the batch %s\n",prm->batch);
+	h=applybatch(g,ch,nc,n,prm,&ins,&del);
+	printf("Insertions: %zu, deletions: %zu, without effect: %zu\n",ins,del,nc-ins-del);
+	printf("Number of nodes: %u\n",h->n);
+	printf("Number of edges: %zu\n",h->e);
+	if (binout!=NULL){
+		printf("Writing binary graph in file %s\n",binout);
+		savebin(h,binout,BIN_DESC,NODMAX);
+	}
+	endphase(&st,PH_BUILD);
+	aff=affected(g,h,ch,nc,prm,&list,&na);
+	printf("Affected nodes: %u\n",na);
+	endphase(&st,PH_SCHED);
+	st.n=h->n;
+	st.e=h->e;
+
+	printtime(&t1);
+
+	printf("Computing the changes of the %s similarities\n",mi->desc);
+	if (prm->prefix!=NULL){
+		printf("Writing the pairs to remove in files %s.del.<thread>, the pairs to add in files %s.add.<thread>\n",prm->prefix,prm->prefix);
+	}
+	dh=updatepairs(g,h,prm,aff,list,na,st.th,cnt);
+	endphase(&st,PH_COMPUTE);
+	printf("Pairs: %llu removed, %llu added, %llu changed\n",cnt[0],cnt[1],cnt[2]);
+
+	printtime(&t1);
+
+	t0=t1-t0;
+	printf("- Overall time = %ldh%ldm%lds\n",(long)t0/3600,((long)t0%3600)/60,(long)t0%60);
+	printdelta(mi,dh);
+	if (hist!=NULL){
+		for (k=0;k<10*mi->nval;k++)
+			hist[k]+=dh[k];
+		printhist(&lp,hist);
+		if (prm->report!=NULL){
+			printf("Writing report in file %s\n",prm->report);
+			writereport(prm->report,&st,hist,mi->nval);
+		}
+	}
+
+	freegraph(g);
+	freegraph(h);
+	free(ch);
+	free(aff);
+	free(list);
+	free(dh);
+	free(hist);
+	freestats(&st);
+	return 0;
+}
+
+#endif